@@ -0,0 +1,95 @@
+#include "distributed_multiplication.h"
+#include <mpi.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+/*
+
+Scaling benchmark of the distributed multiplication, run it with different process counts:
+
+    mpirun -np 1 ./bench_distributed [n] [block] [repetitions] [summa|cannon|2.5d] [layers]
+    mpirun -np 4 ./bench_distributed [n] [block] [repetitions] [summa|cannon|2.5d] [layers]
+
+(the bench_distributed_scaling target runs the three algorithms for several process counts).
+Cannon needs a square number of processes, 2.5D q * q * layers with q >= layers.
+Every process generates its own blocks of n x n operands, then the product is timed (best of the
+repetitions, the slowest process counts). Reported: grid, time, GOP/s in total and per process,
+and the bytes sent + received per process by one product (mean and maximum over the processes).
+
+*/
+
+int
+main(int argc, char **argv) {
+	MPI_Init(&argc, &argv);
+
+	const int n = argc > 1 ? std::atoi(argv[1]) : 1024;
+	const int block = argc > 2 ? std::atoi(argv[2]) : 128;
+	const int repetitions = argc > 3 ? std::atoi(argv[3]) : 3;
+	const char *algorithm = argc > 4 ? argv[4] : "summa";
+	const int layers = argc > 5 ? std::atoi(argv[5]) : 2;
+
+	const bool layered = std::strcmp(algorithm, "2.5d") == 0;
+	const bool cannon = std::strcmp(algorithm, "cannon") == 0;
+
+	int size;
+	MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+	{
+		// Cannon and 2.5D use square grids, SUMMA the most square one
+		int q = 1;
+		while ((q + 1) * (q + 1) <= size) ++q;
+
+		std::unique_ptr<LayeredProcessGrid> stack;
+		std::unique_ptr<ProcessGrid> flat;
+
+		if (layered) stack = std::make_unique<LayeredProcessGrid>(MPI_COMM_WORLD, layers);
+		else if (cannon) flat = std::make_unique<ProcessGrid>(MPI_COMM_WORLD, q, q);
+		else flat = std::make_unique<ProcessGrid>(MPI_COMM_WORLD);
+
+		const ProcessGrid &grid = layered ? stack->layer_grid() : *flat;
+
+		DistributedMatrix A(grid, n, n, block), B(grid, n, n, block), C(grid, n, n, block);
+		build_random_matrix(A, 1);
+		build_random_matrix(B, 2);
+
+		double best = 0.0;
+		CommunicationStats stats;
+
+		for (int r = 0; r < repetitions; ++r) {
+			stats = CommunicationStats();
+
+			MPI_Barrier(MPI_COMM_WORLD);
+			const double start = MPI_Wtime();
+
+			if (layered) multiplyMatrices25D(*stack, A, B, C, &stats);
+			else if (cannon) multiplyMatricesCannon(A, B, C, &stats);
+			else multiplyMatricesSumma(A, B, C, &stats);
+
+			double elapsed = MPI_Wtime() - start;
+			MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+			if (r == 0 || elapsed < best) best = elapsed;
+		}
+
+		const double bytes = static_cast<double>(stats.bytes_sent + stats.bytes_received);
+		double total_bytes = 0.0, max_bytes = 0.0;
+		MPI_Reduce(&bytes, &total_bytes, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+		MPI_Reduce(&bytes, &max_bytes, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+		int rank;
+		MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+		if (rank == 0) {
+			const double gop = 2e-9 * n * n * static_cast<double>(n) / best;
+
+			std::printf("%s processes=%d grid=%dx%dx%d n=%d block=%d time=%.4fs GOP/s=%.2f GOP/s/process=%.2f MB/process=%.2f (max %.2f)\n",
+			            algorithm, size, grid.rows(), grid.cols(), layered ? layers : 1, n, block, best, gop, gop / size,
+			            total_bytes / size * 1e-6, max_bytes * 1e-6);
+		}
+	}
+
+	MPI_Finalize();
+	return 0;
+}
@@ -0,0 +1,265 @@
+#include "matrix_multiplication.h"
+#include "matrix_utils.h"
+#include "batched_multiplication.h"
+#include <vector>
+#include <benchmark/benchmark.h>
+
+/*
+
+Benchmarks of the multiplication engines and of the matrix builders.
+
+Every multiply benchmark reports:
+ * GOP (shown as a rate, i.e. GOP/s): 2*m*n*k integer operations, one multiply and one add per term
+ * bytes_per_second: the compulsory traffic, i.e. A, B and C touched once
+
+The shapes mirror the ones of the correctness tests: square, tall-skinny, matrix-vector
+(as in MatVectorMult), outer product and the degenerate 1x1 product.
+
+NB: the reference kernel is stopped at 1024, at 4096 a single iteration takes minutes
+
+*/
+
+namespace {
+
+void
+run_multiply(benchmark::State &state, MultiplyKernel kernel, int m, int k, int n) {
+	DenseMatrix A, B, C;
+	build_random_matrix(A, m, k, 1);
+	build_random_matrix(B, k, n, 2);
+	build_empty_matrix(C, m, n);
+
+	for (auto _ : state) {
+		multiplyMatricesWithoutErrors(A, B, C, kernel);
+		benchmark::DoNotOptimize(C.data());
+		benchmark::ClobberMemory();
+	}
+
+	const double ops = 2.0 * m * n * k;
+	const double bytes = sizeof(int) * (static_cast<double>(m) * k + static_cast<double>(k) * n + static_cast<double>(m) * n);
+
+	state.counters["GOP"] = benchmark::Counter(ops * 1e-9, benchmark::Counter::kIsIterationInvariantRate);
+	state.SetBytesProcessed(static_cast<int64_t>(bytes * state.iterations()));
+	state.SetLabel(std::to_string(m) + "x" + std::to_string(k) + "x" + std::to_string(n));
+}
+
+
+void
+BM_Square(benchmark::State &state, MultiplyKernel kernel) {
+	const int n = state.range(0);
+	run_multiply(state, kernel, n, n, n);
+}
+
+
+// Many rows, few columns: (n x 64) * (64 x 64)
+void
+BM_TallSkinny(benchmark::State &state, MultiplyKernel kernel) {
+	const int n = state.range(0);
+	run_multiply(state, kernel, n, 64, 64);
+}
+
+
+// (n x n) * (n x 1)
+void
+BM_MatVec(benchmark::State &state, MultiplyKernel kernel) {
+	const int n = state.range(0);
+	run_multiply(state, kernel, n, n, 1);
+}
+
+
+// (n x 1) * (1 x n)
+void
+BM_Outer(benchmark::State &state, MultiplyKernel kernel) {
+	const int n = state.range(0);
+	run_multiply(state, kernel, n, 1, n);
+}
+
+
+void
+BM_Degenerate(benchmark::State &state, MultiplyKernel kernel) {
+	run_multiply(state, kernel, 1, 1, 1);
+}
+
+
+// The vector of vectors entry point, it includes the conversions of the adapter
+void
+BM_SquareVectors(benchmark::State &state) {
+	const int n = state.range(0);
+	auto A = build_random_matrix(n, n, 1);
+	auto B = build_random_matrix(n, n, 2);
+	auto C = build_empty_matrix(n, n);
+
+	for (auto _ : state) {
+		multiplyMatricesWithoutErrors(A, B, C, n, n, n);
+		benchmark::ClobberMemory();
+	}
+
+	state.counters["GOP"] = benchmark::Counter(2e-9 * n * n * n, benchmark::Counter::kIsIterationInvariantRate);
+	state.SetBytesProcessed(static_cast<int64_t>(3.0 * sizeof(int) * n * n * state.iterations()));
+}
+
+
+// 1024 products of n x n matrices, batched against a loop of single calls
+void
+BM_Batched(benchmark::State &state, bool batched) {
+	const int n = state.range(0);
+	const int batch = 1024;
+
+	std::vector<DenseMatrix> A(batch), B(batch), C(batch);
+	for (int b = 0; b < batch; ++b) {
+		build_random_matrix(A[b], n, n, 2 * b);
+		build_random_matrix(B[b], n, n, 2 * b + 1);
+	}
+
+	for (auto _ : state) {
+		if (batched) {
+			multiplyMatricesBatched(A, B, C);
+		} else {
+			for (int b = 0; b < batch; ++b) multiplyMatricesWithoutErrors(A[b], B[b], C[b]);
+		}
+		benchmark::ClobberMemory();
+	}
+
+	state.counters["GOP"] = benchmark::Counter(2e-9 * n * n * n * batch, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+
+// C += A * B for n x n matrices: fused update against a temporary product added in a second pass
+void
+BM_Accumulate(benchmark::State &state, bool fused) {
+	const int n = state.range(0);
+	DenseMatrix A, B, C, T;
+	build_random_matrix(A, n, n, 1);
+	build_random_matrix(B, n, n, 2);
+	build_random_matrix(C, n, n, 3);
+
+	for (auto _ : state) {
+		if (fused) {
+			multiplyMatricesGemm(A, B, C, 1, 1);
+		} else {
+			multiplyMatricesParallel(A, B, T);
+			for (int i = 0; i < n; ++i) {
+				for (int j = 0; j < n; ++j) C(i, j) += T(i, j);
+			}
+		}
+		benchmark::DoNotOptimize(C.data());
+		benchmark::ClobberMemory();
+	}
+
+	state.counters["GOP"] = benchmark::Counter(2e-9 * n * n * n, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+
+// C = A * B^T for n x n matrices: row-dot-row kernel against an explicit transpose then the usual product
+void
+BM_TransposedB(benchmark::State &state, bool in_place) {
+	const int n = state.range(0);
+	DenseMatrix A, B, Bt, C;
+	build_random_matrix(A, n, n, 1);
+	build_random_matrix(B, n, n, 2);
+
+	for (auto _ : state) {
+		if (in_place) {
+			multiplyMatricesWithoutErrors(A, Transpose::No, B, Transpose::Yes, C);
+		} else {
+			Bt.resize(n, n);
+			for (int i = 0; i < n; ++i) {
+				for (int j = 0; j < n; ++j) Bt(j, i) = B(i, j);
+			}
+			multiplyMatricesParallel(A, Bt, C);
+		}
+		benchmark::DoNotOptimize(C.data());
+		benchmark::ClobberMemory();
+	}
+
+	state.counters["GOP"] = benchmark::Counter(2e-9 * n * n * n, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+
+void
+BM_BuildRandomDense(benchmark::State &state) {
+	const int n = state.range(0);
+	DenseMatrix M;
+
+	for (auto _ : state) {
+		build_random_matrix(M, n, n, 0);
+		benchmark::DoNotOptimize(M.data());
+	}
+
+	state.SetBytesProcessed(static_cast<int64_t>(sizeof(int)) * n * n * state.iterations());
+}
+
+
+void
+BM_BuildRandomVectors(benchmark::State &state) {
+	const int n = state.range(0);
+
+	for (auto _ : state) {
+		auto M = build_random_matrix(n, n, 0);
+		benchmark::DoNotOptimize(M.data());
+	}
+
+	state.SetBytesProcessed(static_cast<int64_t>(sizeof(int)) * n * n * state.iterations());
+}
+
+
+void
+BM_BuildEmptyDense(benchmark::State &state) {
+	const int n = state.range(0);
+	DenseMatrix M;
+
+	for (auto _ : state) {
+		build_empty_matrix(M, n, n);
+		benchmark::DoNotOptimize(M.data());
+	}
+
+	state.SetBytesProcessed(static_cast<int64_t>(sizeof(int)) * n * n * state.iterations());
+}
+
+
+void
+BM_BuildEmptyVectors(benchmark::State &state) {
+	const int n = state.range(0);
+
+	for (auto _ : state) {
+		auto M = build_empty_matrix(n, n);
+		benchmark::DoNotOptimize(M.data());
+	}
+
+	state.SetBytesProcessed(static_cast<int64_t>(sizeof(int)) * n * n * state.iterations());
+}
+
+}
+
+
+#define MULTIPLY_BENCHMARKS(shape, max_reference) \
+	BENCHMARK_CAPTURE(shape, reference, MultiplyKernel::Reference)->RangeMultiplier(4)->Range(1, max_reference)->Unit(benchmark::kMicrosecond); \
+	BENCHMARK_CAPTURE(shape, blocked, MultiplyKernel::Blocked)->RangeMultiplier(4)->Range(1, 4096)->Unit(benchmark::kMicrosecond); \
+	BENCHMARK_CAPTURE(shape, parallel, MultiplyKernel::Parallel)->RangeMultiplier(4)->Range(1, 4096)->Unit(benchmark::kMicrosecond)
+
+MULTIPLY_BENCHMARKS(BM_Square, 1024);
+BENCHMARK_CAPTURE(BM_Square, strassen, MultiplyKernel::Strassen)->RangeMultiplier(2)->Range(256, 4096)->Unit(benchmark::kMicrosecond);
+MULTIPLY_BENCHMARKS(BM_TallSkinny, 4096);
+MULTIPLY_BENCHMARKS(BM_MatVec, 4096);
+MULTIPLY_BENCHMARKS(BM_Outer, 4096);
+
+BENCHMARK_CAPTURE(BM_Degenerate, reference, MultiplyKernel::Reference);
+BENCHMARK_CAPTURE(BM_Degenerate, blocked, MultiplyKernel::Blocked);
+BENCHMARK_CAPTURE(BM_Degenerate, parallel, MultiplyKernel::Parallel);
+
+BENCHMARK_CAPTURE(BM_Batched, loop, false)->DenseRange(2, 8, 2)->Arg(16)->Arg(32)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Batched, batched, true)->DenseRange(2, 8, 2)->Arg(16)->Arg(32)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_CAPTURE(BM_Accumulate, separate, false)->RangeMultiplier(4)->Range(16, 1024)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Accumulate, fused, true)->RangeMultiplier(4)->Range(16, 1024)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_CAPTURE(BM_TransposedB, explicit, false)->RangeMultiplier(4)->Range(16, 1024)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_TransposedB, in_place, true)->RangeMultiplier(4)->Range(16, 1024)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_SquareVectors)->RangeMultiplier(4)->Range(1, 1024)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_BuildRandomDense)->RangeMultiplier(4)->Range(1, 4096);
+BENCHMARK(BM_BuildRandomVectors)->RangeMultiplier(4)->Range(1, 4096);
+BENCHMARK(BM_BuildEmptyDense)->RangeMultiplier(4)->Range(1, 4096);
+BENCHMARK(BM_BuildEmptyVectors)->RangeMultiplier(4)->Range(1, 4096);
+
+BENCHMARK_MAIN();
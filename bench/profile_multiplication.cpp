@@ -0,0 +1,213 @@
+#include "matrix_multiplication.h"
+#include "matrix_utils.h"
+#include "thread_pool.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+/*
+
+Hardware counters of the multiplication, read with Linux perf_event:
+
+    ./profile_multiplication [repetitions]
+
+For every shape the vector of vectors multiplyMatricesWithoutErrors (the operands come from
+build_random_matrix) and, for comparison, the DenseMatrix one are run `repetitions` times
+(default 3) and the counters of the fastest run are reported next to its GOP/s:
+
+ * cycles and instructions (and their ratio, IPC)
+ * L1D and last level cache read misses, dTLB read misses
+ * vector instructions retired: there is no generic perf event for it, so it is counted only
+   when PROFILE_VECTOR_EVENT holds the raw event code of the CPU (the `perf list` value,
+   e.g. PROFILE_VECTOR_EVENT=0x...), otherwise reported as n/a
+ * page faults, a software event counted even where the hardware ones are not
+
+The counters follow the calling thread only, so the default thread pool is reduced to one
+thread: every product runs on the measured thread. Counters the kernel or the machine does not
+provide (perf_event_paranoid, virtual machines without a PMU, ...) are reported as n/a and the
+timings are still printed. Counts are scaled when the PMU had to multiplex the events.
+
+*/
+
+namespace {
+
+struct Shape {
+	int m;
+	int k;
+	int n;
+};
+
+// Square sizes, tall-skinny, matrix-vector, vector-matrix and outer product
+const Shape SHAPES[] = {
+	{64, 64, 64}, {256, 256, 256}, {512, 512, 512}, {1024, 1024, 1024},
+	{4096, 64, 64}, {4096, 4096, 1}, {1, 4096, 4096}, {2048, 1, 2048},
+};
+
+
+struct CounterSpec {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+};
+
+uint64_t
+cache_event(const uint64_t cache, const uint64_t result) {
+	return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+}
+
+
+class Counter {
+public:
+	Counter(const CounterSpec &spec, const bool requested) : m_fd(-1) {
+		if (!requested) return;
+
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = spec.type;
+		attr.config = spec.config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+		if (m_fd < 0) m_error = errno;
+	}
+
+	~Counter() {
+		if (m_fd >= 0) close(m_fd);
+	}
+
+	Counter(const Counter &) = delete;
+	Counter &operator=(const Counter &) = delete;
+
+	bool available() const { return m_fd >= 0; }
+	int error() const { return m_error; }
+
+	void start() {
+		if (m_fd < 0) return;
+		ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+
+	void stop() {
+		if (m_fd >= 0) ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+	}
+
+	// Count since start(), scaled by enabled / running time; -1 if unavailable
+	double value() const {
+		if (m_fd < 0) return -1.0;
+
+		uint64_t data[3];
+		if (read(m_fd, data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[2] == 0) return -1.0;
+		return static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]);
+	}
+
+private:
+	int m_fd;
+	int m_error = 0;
+};
+
+
+void
+print_value(const double value) {
+	if (value < 0) std::printf(" %12s", "n/a");
+	else std::printf(" %12.4g", value);
+}
+
+
+template <typename Multiply>
+void
+profile(const char *engine, const Shape &shape, const int repetitions, const std::vector<std::unique_ptr<Counter>> &counters, Multiply multiply) {
+	double best = -1.0;
+	std::vector<double> values(counters.size(), -1.0);
+
+	for (int r = 0; r < repetitions; ++r) {
+		for (const auto &counter : counters) counter->start();
+		const auto start = std::chrono::steady_clock::now();
+
+		multiply();
+
+		const auto end = std::chrono::steady_clock::now();
+		for (const auto &counter : counters) counter->stop();
+
+		const double seconds = std::chrono::duration<double>(end - start).count();
+		if (best < 0 || seconds < best) {
+			best = seconds;
+			for (size_t c = 0; c < counters.size(); ++c) values[c] = counters[c]->value();
+		}
+	}
+
+	const double gops = 2e-9 * shape.m * static_cast<double>(shape.k) * shape.n / best;
+	std::printf("%-8s %5dx%5dx%5d %10.6f %8.2f", engine, shape.m, shape.k, shape.n, best, gops);
+
+	// values[0] and values[1] are the cycles and the instructions
+	print_value(values[0] > 0 && values[1] >= 0 ? values[1] / values[0] : -1.0);
+	for (double value : values) print_value(value);
+	std::printf("\n");
+}
+
+}
+
+
+int
+main(int argc, char **argv) {
+	const int repetitions = argc > 1 ? std::max(1, std::atoi(argv[1])) : 3;
+
+	set_default_thread_count(1);
+
+	const char *vector_event = std::getenv("PROFILE_VECTOR_EVENT");
+
+	const CounterSpec specs[] = {
+		{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+		{"instr", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{"L1D-miss", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+		{"LLC-miss", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+		{"dTLB-miss", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+		{"vector", PERF_TYPE_RAW, vector_event ? std::strtoull(vector_event, nullptr, 0) : 0},
+		{"page-fault", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+	};
+
+	std::vector<std::unique_ptr<Counter>> counters;
+	for (const CounterSpec &spec : specs) {
+		// Without a raw code there is nothing meaningful to count for the vector instructions
+		const bool requested = spec.type != PERF_TYPE_RAW || vector_event;
+		counters.push_back(std::make_unique<Counter>(spec, requested));
+
+		if (requested && !counters.back()->available())
+			std::fprintf(stderr, "perf_event: %s unavailable (%s)\n", spec.name, std::strerror(counters.back()->error()));
+	}
+
+	std::printf("%-8s %17s %10s %8s %12s", "engine", "m x k x n", "seconds", "GOP/s", "IPC");
+	for (const CounterSpec &spec : specs) std::printf(" %12s", spec.name);
+	std::printf("\n");
+
+	for (const Shape &shape : SHAPES) {
+		const std::vector<std::vector<int>> A = build_random_matrix(shape.m, shape.k, 1);
+		const std::vector<std::vector<int>> B = build_random_matrix(shape.k, shape.n, 2);
+		std::vector<std::vector<int>> C(shape.m, std::vector<int>(shape.n, 0));
+
+		const DenseMatrix denseA(A, shape.m, shape.k), denseB(B, shape.k, shape.n);
+		DenseMatrix denseC(shape.m, shape.n);
+
+		profile("vectors", shape, repetitions, counters, [&] {
+			multiplyMatricesWithoutErrors(A, B, C, shape.m, shape.k, shape.n);
+		});
+		profile("dense", shape, repetitions, counters, [&] {
+			multiplyMatricesWithoutErrors(denseA, denseB, denseC);
+		});
+	}
+
+	return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef BATCHED_MULTIPLICATION_H
+#define BATCHED_MULTIPLICATION_H
+
+
+#include <cstddef>
+#include <vector>
+#include "dense_matrix.h"
+
+
+// Batched multiplication of many small matrices of the same shape: C[b] = A[b] * B[b]
+// for every b in [0, batch), every matrix row-major with the given leading dimension.
+//
+// Tiny products (every dimension <= BATCH_INTERLEAVE_MAX) are regrouped so that each SIMD lane
+// works on a different matrix of the batch, the larger ones run one matrix at a time.
+// The batch is split across the default thread pool in both cases.
+
+constexpr int BATCH_INTERLEAVE_MAX = 8;
+
+// Strided batch: matrix b of A starts at A + b*strideA (likewise for B and C)
+void multiplyMatricesBatched(int batch, int M, int N, int K,
+	const int *A, std::ptrdiff_t lda, std::ptrdiff_t strideA,
+	const int *B, std::ptrdiff_t ldb, std::ptrdiff_t strideB,
+	int *C, std::ptrdiff_t ldc, std::ptrdiff_t strideC);
+
+// Array of pointers: matrix b of A starts at A[b] (likewise for B and C)
+void multiplyMatricesBatched(int batch, int M, int N, int K,
+	const int *const *A, std::ptrdiff_t lda,
+	const int *const *B, std::ptrdiff_t ldb,
+	int *const *C, std::ptrdiff_t ldc);
+
+// Convenience overload, every A[b] (resp. B[b]) must have the shape and stride of A[0] (resp. B[0]).
+// C is resized to A.size() matrices of A[0].rows() x B[0].cols(). Throws std::invalid_argument
+// if B does not hold A.size() matrices or B[0].rows() != A[0].cols()
+void multiplyMatricesBatched(const std::vector<DenseMatrix> &A, const std::vector<DenseMatrix> &B, std::vector<DenseMatrix> &C);
+
+
+
+#endif // BATCHED_MULTIPLICATION_H
@@ -0,0 +1,124 @@
+#ifndef DENSE_MATRIX_H
+#define DENSE_MATRIX_H
+
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include "matrix_allocator.h"
+
+
+// Dense row-major matrix backed by a single contiguous buffer.
+//
+// Element (i,j) lives at data()[i*stride() + j]: the stride may be larger than the number
+// of columns, in which case the tail of every row is padding and is never read by the kernels.
+// Compared to std::vector<std::vector<T>> there is one heap block per matrix instead of one per row,
+// and walking down a column is a constant stride instead of a pointer chase.
+// The buffer is 64-byte aligned and comes from the matrix allocator (see matrix_allocator.h),
+// so dropping a matrix and building another of the same shape reuses its memory.
+template <typename T>
+class BasicDenseMatrix {
+public:
+	using value_type = T;
+
+	BasicDenseMatrix() = default;
+
+	BasicDenseMatrix(const int rows, const int cols)
+		: BasicDenseMatrix(rows, cols, cols) {}
+
+	BasicDenseMatrix(const int rows, const int cols, const int stride)
+		: m_rows(rows), m_cols(cols), m_stride(stride),
+		  m_data(static_cast<size_t>(rows) * static_cast<size_t>(stride), T(0)) {}
+
+	// Copy the leading rows x cols block of a vector of vectors
+	BasicDenseMatrix(const std::vector<std::vector<T>> &M, const int rows, const int cols)
+		: BasicDenseMatrix(rows, cols) {
+		for (int i = 0; i < rows; ++i) {
+			std::copy(M[i].begin(), M[i].begin() + cols, row(i));
+		}
+	}
+
+	explicit BasicDenseMatrix(const std::vector<std::vector<T>> &M)
+		: BasicDenseMatrix(M, static_cast<int>(M.size()), M.empty() ? 0 : static_cast<int>(M[0].size())) {}
+
+	// Buffer allocated from arena, and so are those of every resize(). A copy of the matrix goes
+	// back to the pool. NB: the matrix must be destroyed before the arena is rewound past it
+	explicit BasicDenseMatrix(MatrixArena &arena)
+		: m_data(MatrixAllocator<T>(arena)) {}
+
+	BasicDenseMatrix(const int rows, const int cols, MatrixArena &arena)
+		: m_rows(rows), m_cols(cols), m_stride(cols),
+		  m_data(static_cast<size_t>(rows) * static_cast<size_t>(cols), T(0), MatrixAllocator<T>(arena)) {}
+
+	int rows() const { return m_rows; }
+	int cols() const { return m_cols; }
+	int stride() const { return m_stride; }
+	bool empty() const { return m_rows == 0 || m_cols == 0; }
+
+	// Number of elements the buffer can hold before resize() has to allocate
+	size_t capacity() const { return m_data.capacity(); }
+
+	// Arena the buffer comes from, nullptr for the pool
+	MatrixArena *arena() const { return m_data.get_allocator().arena(); }
+
+	T *data() { return m_data.data(); }
+	const T *data() const { return m_data.data(); }
+
+	T *row(const int i) { return m_data.data() + static_cast<size_t>(i) * m_stride; }
+	const T *row(const int i) const { return m_data.data() + static_cast<size_t>(i) * m_stride; }
+
+	T &operator()(const int i, const int j) { return row(i)[j]; }
+	const T &operator()(const int i, const int j) const { return row(i)[j]; }
+
+	// Change the shape, the buffer is reused when it is big enough (contents are zeroed)
+	void resize(const int rows, const int cols) {
+		m_rows = rows;
+		m_cols = cols;
+		m_stride = cols;
+		m_data.assign(static_cast<size_t>(rows) * static_cast<size_t>(cols), T(0));
+	}
+
+	void fill(const T value) {
+		for (int i = 0; i < m_rows; ++i) {
+			std::fill(row(i), row(i) + m_cols, value);
+		}
+	}
+
+	// Write the matrix into the leading rows x cols block of an already sized vector of vectors
+	void copy_to(std::vector<std::vector<T>> &M) const {
+		for (int i = 0; i < m_rows; ++i) {
+			std::copy(row(i), row(i) + m_cols, M[i].begin());
+		}
+	}
+
+	std::vector<std::vector<T>> to_vectors() const {
+		std::vector<std::vector<T>> result(m_rows, std::vector<T>(m_cols));
+		copy_to(result);
+		return result;
+	}
+
+	// NB: compares only the logical content, padding is ignored
+	bool operator==(const BasicDenseMatrix &other) const {
+		if (m_rows != other.m_rows || m_cols != other.m_cols) return false;
+
+		for (int i = 0; i < m_rows; ++i) {
+			if (!std::equal(row(i), row(i) + m_cols, other.row(i))) return false;
+		}
+
+		return true;
+	}
+
+	bool operator!=(const BasicDenseMatrix &other) const { return !(*this == other); }
+
+private:
+	int m_rows = 0;
+	int m_cols = 0;
+	int m_stride = 0;
+	pooled_vector<T> m_data;
+};
+
+
+using DenseMatrix = BasicDenseMatrix<int>;
+
+
+#endif // DENSE_MATRIX_H
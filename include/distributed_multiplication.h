@@ -0,0 +1,155 @@
+#ifndef DISTRIBUTED_MULTIPLICATION_H
+#define DISTRIBUTED_MULTIPLICATION_H
+
+
+#include <mpi.h>
+#include <memory>
+#include "dense_matrix.h"
+
+
+// Multiplication of matrices spread over the processes of an MPI communicator.
+//
+// The processes are arranged in a rows x cols grid and the matrices are distributed
+// block-cyclically, as in ScaLAPACK: the matrix is cut in nb x nb blocks and block (I, J)
+// lives on process (I mod rows, J mod cols). Every process stores the blocks it owns
+// packed in one DenseMatrix, in the same relative order, so no process ever holds more
+// than its share of any matrix.
+
+
+// 2D grid of processes, row-major over the ranks of comm. Owns the communicators of its
+// rows and of its columns, used by the collective steps of the algorithms
+class ProcessGrid {
+public:
+	// rows = cols = 0 picks a grid as square as possible (MPI_Dims_create), rows * cols must be the size of comm
+	explicit ProcessGrid(MPI_Comm comm, int rows = 0, int cols = 0);
+	~ProcessGrid();
+
+	ProcessGrid(const ProcessGrid &) = delete;
+	ProcessGrid &operator=(const ProcessGrid &) = delete;
+
+	MPI_Comm comm() const { return m_comm; }
+	MPI_Comm row_comm() const { return m_row_comm; }
+	MPI_Comm col_comm() const { return m_col_comm; }
+
+	int rows() const { return m_rows; }
+	int cols() const { return m_cols; }
+	int my_row() const { return m_my_row; }
+	int my_col() const { return m_my_col; }
+	int rank() const { return m_rank; }
+
+	// Rank in comm() of the process at (row, col)
+	int rank_of(const int row, const int col) const { return row * m_cols + col; }
+
+private:
+	MPI_Comm m_comm;
+	MPI_Comm m_row_comm;
+	MPI_Comm m_col_comm;
+	int m_rows;
+	int m_cols;
+	int m_my_row;
+	int m_my_col;
+	int m_rank;
+};
+
+
+// Number of the n rows (or columns) cut in blocks of nb that process p of nprocs owns
+int block_cyclic_extent(int n, int nb, int p, int nprocs);
+
+
+// The share of a rows x cols matrix owned by the calling process
+class DistributedMatrix {
+public:
+	DistributedMatrix(const ProcessGrid &grid, int rows, int cols, int block);
+
+	const ProcessGrid &grid() const { return *m_grid; }
+
+	int rows() const { return m_rows; }
+	int cols() const { return m_cols; }
+	int block() const { return m_block; }
+
+	// Owned blocks, packed: local (i, j) is global (local_to_global_row(i), local_to_global_col(j))
+	DenseMatrix &local() { return m_local; }
+	const DenseMatrix &local() const { return m_local; }
+
+	int local_to_global_row(int i) const;
+	int local_to_global_col(int j) const;
+
+private:
+	const ProcessGrid *m_grid;
+	int m_rows;
+	int m_cols;
+	int m_block;
+	DenseMatrix m_local;
+};
+
+
+// Every process generates its own blocks with the counter based generator of matrix_utils.h,
+// the global matrix is the one build_random_matrix(M, rows, cols, seed) would give and is never assembled
+void build_random_matrix(DistributedMatrix &result, int seed);
+
+// Distribute a matrix held by root (the argument is ignored on the other processes) and assemble it back on root
+void scatter_matrix(const DenseMatrix &global, DistributedMatrix &result, int root = 0);
+void gather_matrix(const DistributedMatrix &M, DenseMatrix &global, int root = 0);
+
+
+// Volume moved by the calling process during one multiplication. Collectives are counted as their
+// logical point to point volume: the root of a broadcast sends the data to every other member, each
+// of them receives it once (the MPI library may route it through a tree)
+struct CommunicationStats {
+	long long bytes_sent = 0;
+	long long bytes_received = 0;
+	long long messages = 0;
+};
+
+
+// SUMMA (van de Geijn and Watts): for every block column k of A and block row k of B, the owners
+// broadcast their panels along the process rows / columns and every process accumulates
+// C_local += A_panel * B_panel with the local kernel (multiplyMatricesGemm).
+// A, B and C must live on the same grid with the same block size, C must be A.rows() x B.cols()
+void multiplyMatricesSumma(const DistributedMatrix &A, const DistributedMatrix &B, DistributedMatrix &C, CommunicationStats *stats = nullptr);
+
+// Cannon's algorithm, on a square q x q grid only: after an initial skew every process multiplies
+// the pair of blocks it holds and passes A to its left and B upwards, q times. Point to point
+// shifts only, and every process sends 2 blocks per step instead of taking part in 2 broadcasts.
+// With the block-cyclic layout the local blocks of a process act as its one Cannon block.
+// Same requirements as multiplyMatricesSumma
+void multiplyMatricesCannon(const DistributedMatrix &A, const DistributedMatrix &B, DistributedMatrix &C, CommunicationStats *stats = nullptr);
+
+
+// q x q x c processes as c stacked copies ("layers") of a q x q grid, for the 2.5D algorithm.
+// Process (i, j) of every layer is linked to the processes at (i, j) of the other layers
+class LayeredProcessGrid {
+public:
+	// The size of comm must be q * q * layers for some q >= layers
+	LayeredProcessGrid(MPI_Comm comm, int layers);
+	~LayeredProcessGrid();
+
+	LayeredProcessGrid(const LayeredProcessGrid &) = delete;
+	LayeredProcessGrid &operator=(const LayeredProcessGrid &) = delete;
+
+	// The q x q grid of the layer of the calling process
+	const ProcessGrid &layer_grid() const { return *m_layer_grid; }
+
+	int layers() const { return m_layers; }
+	int layer() const { return m_layer; }
+
+	// The processes at the same (i, j) in every layer, ranked by layer
+	MPI_Comm depth_comm() const { return m_depth_comm; }
+
+private:
+	int m_layers;
+	int m_layer;
+	MPI_Comm m_depth_comm;
+	std::unique_ptr<ProcessGrid> m_layer_grid;
+};
+
+// 2.5D Cannon (Solomonik and Demmel): A and B, distributed on layer 0, are replicated on the c layers,
+// every layer runs q / c of the q Cannon steps and the partial products are summed back on layer 0.
+// Every process moves about sqrt(c) times fewer bytes than with Cannon on the same number of processes,
+// for c times the memory. A, B and C are distributed on layer_grid() (same shapes on every layer):
+// only the layer 0 copies of A and B are read and C holds the product on layer 0 only
+void multiplyMatrices25D(const LayeredProcessGrid &grid, const DistributedMatrix &A, const DistributedMatrix &B, DistributedMatrix &C, CommunicationStats *stats = nullptr);
+
+
+
+#endif // DISTRIBUTED_MULTIPLICATION_H
@@ -0,0 +1,125 @@
+#ifndef FIXED_MATRIX_H
+#define FIXED_MATRIX_H
+
+
+#include <array>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <stdexcept>
+#include <initializer_list>
+
+
+// Matrix with dimensions known at compile time, stored inline (no heap allocation).
+//
+// Meant for the tiny products (2x2, 3x3, 4x4, ...) where building three vectors of vectors
+// costs more than the arithmetic. The product is fully unrolled and usable in constant expressions:
+//
+//	constexpr FixedMatrix<int, 2, 2> A = {{1, 2}, {3, 4}};
+//	static_assert((A * A)(0, 0) == 7, "");
+template <typename T, int R, int C>
+class FixedMatrix {
+	static_assert(R > 0 && C > 0, "FixedMatrix dimensions must be positive");
+
+public:
+	using value_type = T;
+
+	constexpr FixedMatrix() : m_data{} {}
+
+	constexpr explicit FixedMatrix(const std::array<T, R * C> &elements) : m_data(elements) {}
+
+	// Row by row, missing entries are zero. More than R rows or C entries in a row throws
+	// std::invalid_argument, which is a compile error in a constant expression
+	constexpr FixedMatrix(std::initializer_list<std::initializer_list<T>> rows) : m_data{} {
+		if (rows.size() > static_cast<size_t>(R)) throw std::invalid_argument("FixedMatrix: too many rows");
+
+		int i = 0;
+		for (const auto &row : rows) {
+			if (row.size() > static_cast<size_t>(C)) throw std::invalid_argument("FixedMatrix: too many columns");
+
+			int j = 0;
+			for (const T &value : row) {
+				m_data[i * C + j] = value;
+				++j;
+			}
+			++i;
+		}
+	}
+
+	// Conversions from and to the vector of vectors representation, the sizes must match
+	explicit FixedMatrix(const std::vector<std::vector<T>> &M) : m_data{} {
+		for (int i = 0; i < R; ++i) {
+			for (int j = 0; j < C; ++j) {
+				m_data[i * C + j] = M[i][j];
+			}
+		}
+	}
+
+	std::vector<std::vector<T>> to_vectors() const {
+		std::vector<std::vector<T>> result(R, std::vector<T>(C));
+
+		for (int i = 0; i < R; ++i) {
+			for (int j = 0; j < C; ++j) {
+				result[i][j] = m_data[i * C + j];
+			}
+		}
+
+		return result;
+	}
+
+	static constexpr int rows() { return R; }
+	static constexpr int cols() { return C; }
+
+	constexpr T &operator()(const int i, const int j) { return m_data[i * C + j]; }
+	constexpr const T &operator()(const int i, const int j) const { return m_data[i * C + j]; }
+
+	constexpr const T *data() const { return m_data.data(); }
+
+	constexpr bool operator==(const FixedMatrix &other) const {
+		for (int e = 0; e < R * C; ++e) {
+			if (m_data[e] != other.m_data[e]) return false;
+		}
+		return true;
+	}
+
+	constexpr bool operator!=(const FixedMatrix &other) const { return !(*this == other); }
+
+private:
+	std::array<T, R * C> m_data;
+};
+
+
+namespace fixed_matrix_detail {
+
+// Row i of A times column j of B, one term per element of the pack
+template <typename T, int R, int K, int C, std::size_t... P>
+constexpr T dot(const FixedMatrix<T, R, K> &A, const FixedMatrix<T, K, C> &B, const int i, const int j, std::index_sequence<P...>) {
+	return (T(0) + ... + (A(i, static_cast<int>(P)) * B(static_cast<int>(P), j)));
+}
+
+// One dot product per element of C
+template <typename T, int R, int K, int C, std::size_t... E>
+constexpr FixedMatrix<T, R, C> multiply(const FixedMatrix<T, R, K> &A, const FixedMatrix<T, K, C> &B, std::index_sequence<E...>) {
+	return FixedMatrix<T, R, C>(std::array<T, R * C>{
+		dot(A, B, static_cast<int>(E) / C, static_cast<int>(E) % C, std::make_index_sequence<K>{})...
+	});
+}
+
+}
+
+
+template <typename T, int R, int K, int C>
+constexpr FixedMatrix<T, R, C> operator*(const FixedMatrix<T, R, K> &A, const FixedMatrix<T, K, C> &B) {
+	return fixed_matrix_detail::multiply(A, B, std::make_index_sequence<R * C>{});
+}
+
+
+// Same calling convention of the other kernels
+template <typename T, int R, int K, int C>
+constexpr void multiplyMatricesWithoutErrors(const FixedMatrix<T, R, K> &A, const FixedMatrix<T, K, C> &B, FixedMatrix<T, R, C> &result) {
+	result = A * B;
+}
+
+
+
+#endif // FIXED_MATRIX_H
@@ -0,0 +1,163 @@
+#ifndef MATRIX_ALLOCATOR_H
+#define MATRIX_ALLOCATOR_H
+
+
+#include <vector>
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <type_traits>
+
+
+// Memory for the matrix buffers.
+//
+// Every buffer is 64-byte aligned (one cache line, one AVX-512 register) and comes from one of two places:
+//  * the process wide BufferPool: freed buffers are kept in a free list per size and handed back
+//    to the next request of the same size, so a loop over same-shape matrices stops calling malloc
+//  * a MatrixArena, for the containers built with MatrixAllocator(arena) (e.g. a BasicDenseMatrix
+//    constructed with an arena): allocations bump a pointer and are all given back at once when
+//    the arena is rewound
+//
+// BasicDenseMatrix stores its elements with MatrixAllocator, so the builders and the multiply
+// routines (including their temporaries) draw from the pool without any change at the call site.
+// The arena is opt-in per object: the allocator captures it at construction and keeps it for the
+// lifetime of the container, so the matrices created elsewhere (and those the multiply routines
+// resize) never end up in it.
+
+
+constexpr size_t MATRIX_ALIGNMENT = 64;
+
+// Above this many cached bytes the pool frees buffers instead of keeping them
+constexpr size_t MATRIX_POOL_MAX_CACHED = size_t(256) << 20;
+
+
+struct BufferPoolStats {
+	size_t hits = 0;          // requests served from the free lists
+	size_t misses = 0;        // requests that went to the system allocator
+	size_t cached_bytes = 0;  // bytes currently sitting in the free lists
+};
+
+class BufferPool {
+public:
+	BufferPool() = default;
+	~BufferPool();
+
+	BufferPool(const BufferPool &) = delete;
+	BufferPool &operator=(const BufferPool &) = delete;
+
+	// bytes is rounded up to a multiple of MATRIX_ALIGNMENT, the result is aligned to it
+	void *acquire(size_t bytes);
+	void release(void *block, size_t bytes);
+
+	// Give every cached buffer back to the system
+	void trim();
+
+	BufferPoolStats stats() const;
+
+private:
+	mutable std::mutex m_mutex;
+	std::unordered_map<size_t, std::vector<void *>> m_free;
+	BufferPoolStats m_stats;
+};
+
+// Shared by all the matrices, never destroyed (matrices with static storage may outlive it otherwise)
+BufferPool &default_buffer_pool();
+
+
+// Bump allocator over a list of aligned chunks. Not thread safe: the containers drawing from one
+// arena must all be (re)sized by the same thread.
+class MatrixArena {
+public:
+	struct Mark {
+		size_t chunk = 0;
+		size_t offset = 0;
+	};
+
+	explicit MatrixArena(size_t chunk_bytes = size_t(4) << 20);
+	~MatrixArena();
+
+	MatrixArena(const MatrixArena &) = delete;
+	MatrixArena &operator=(const MatrixArena &) = delete;
+
+	void *allocate(size_t bytes);
+
+	// Everything allocated after mark is released, the chunks are kept for the next allocations
+	Mark mark() const { return {m_chunk, m_offset}; }
+	void rewind(const Mark &mark);
+	void reset() { rewind({}); }
+
+	size_t used() const;
+	size_t capacity() const;
+
+private:
+	struct Chunk {
+		char *base;
+		size_t size;
+	};
+
+	std::vector<Chunk> m_chunks;
+	size_t m_chunk_bytes;
+	size_t m_chunk = 0;
+	size_t m_offset = 0;
+};
+
+// Rewinds arena on destruction to where it was when the scope started, so scopes nest.
+// It redirects nothing: only the containers built with the arena allocate from it.
+// NB: every container allocated from the arena inside the scope must be destroyed before the scope
+// ends, its memory is handed to the next allocations from the arena
+class ArenaScope {
+public:
+	explicit ArenaScope(MatrixArena &arena);
+	~ArenaScope();
+
+	ArenaScope(const ArenaScope &) = delete;
+	ArenaScope &operator=(const ArenaScope &) = delete;
+
+private:
+	MatrixArena &m_arena;
+	MatrixArena::Mark m_mark;
+};
+
+
+// Untyped entry points of MatrixAllocator: from arena if not null, from the default pool otherwise.
+// A block is freed with the size and the arena it was allocated with
+void *allocate_matrix_buffer(size_t bytes, MatrixArena *arena = nullptr);
+void deallocate_matrix_buffer(void *block, size_t bytes, MatrixArena *arena = nullptr);
+
+
+// Allocator of the matrix containers: the default pool, or the arena it was constructed with.
+// Copies of a container go back to the pool, and an assignment or a move assignment keeps the
+// allocator of the destination, so a container never silently moves into (or out of) an arena
+template <typename T>
+struct MatrixAllocator {
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::false_type;
+	using propagate_on_container_move_assignment = std::false_type;
+	using propagate_on_container_swap = std::true_type;
+	using is_always_equal = std::false_type;
+
+	MatrixAllocator() = default;
+	explicit MatrixAllocator(MatrixArena &arena) : m_arena(&arena) {}
+	template <typename U> MatrixAllocator(const MatrixAllocator<U> &other) : m_arena(other.arena()) {}
+
+	T *allocate(size_t n) { return static_cast<T *>(allocate_matrix_buffer(n * sizeof(T), m_arena)); }
+	void deallocate(T *p, size_t n) { deallocate_matrix_buffer(p, n * sizeof(T), m_arena); }
+
+	MatrixAllocator select_on_container_copy_construction() const { return MatrixAllocator(); }
+
+	// nullptr for the pool
+	MatrixArena *arena() const { return m_arena; }
+
+	template <typename U> bool operator==(const MatrixAllocator<U> &other) const { return m_arena == other.arena(); }
+	template <typename U> bool operator!=(const MatrixAllocator<U> &other) const { return m_arena != other.arena(); }
+
+private:
+	MatrixArena *m_arena = nullptr;
+};
+
+template <typename T>
+using pooled_vector = std::vector<T, MatrixAllocator<T>>;
+
+
+
+#endif // MATRIX_ALLOCATOR_H
@@ -0,0 +1,50 @@
+#ifndef MATRIX_CHAIN_H
+#define MATRIX_CHAIN_H
+
+
+#include <vector>
+#include <string>
+#include <functional>
+#include "dense_matrix.h"
+
+
+// Cost of one product of an m x k matrix (with density densityA) by a k x n one (density densityB)
+using ChainCostModel = std::function<double(int m, int k, int n, double densityA, double densityB)>;
+
+// 2mkn operations, whatever the content
+double dense_chain_cost(int m, int k, int n, double densityA, double densityB);
+
+// Only the non zeros of the sparser operand do work (see sparse_matrix.h)
+double sparse_chain_cost(int m, int k, int n, double densityA, double densityB);
+
+
+// Optimal order of a chain M0 * M1 * ... * M(n-1)
+struct ChainPlan {
+	// split[i][j] = s means that Mi..Mj is computed as (Mi..Ms) * (Ms+1..Mj)
+	std::vector<std::vector<int>> split;
+	double cost = 0.0;
+
+	// Parenthesised form, e.g. "((M0 M1) M2)"
+	std::string to_string() const;
+};
+
+// Classic O(n^3) dynamic programming over the subchains. dims has n+1 entries, Mi being dims[i] x dims[i+1].
+// densities (one per matrix, empty means all dense) are propagated to the partial products assuming
+// independent non zeros, so that the cost model can take sparsity into account
+ChainPlan plan_matrix_chain(const std::vector<int> &dims, const std::vector<double> &densities = {}, const ChainCostModel &model = dense_chain_cost);
+
+
+struct ChainOptions {
+	// Measure the density of the inputs, plan with sparse_chain_cost and run every step with multiplyMatricesAuto
+	bool sparsity_aware = false;
+};
+
+// result = matrices[0] * matrices[1] * ... in the order found by plan_matrix_chain.
+// The partial products live in a small pool of buffers reused along the evaluation (at most one per
+// level of nesting), instead of a fresh matrix per step. The plan used is returned in plan if given.
+// NB: result must not be one of the inputs
+void multiplyChain(const std::vector<const DenseMatrix *> &matrices, DenseMatrix &result, const ChainOptions &options = {}, ChainPlan *plan = nullptr);
+
+
+
+#endif // MATRIX_CHAIN_H
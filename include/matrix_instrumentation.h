@@ -0,0 +1,85 @@
+#ifndef MATRIX_INSTRUMENTATION_H
+#define MATRIX_INSTRUMENTATION_H
+
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <chrono>
+#include <cstddef>
+
+
+// Opt-in instrumentation of the multiply entry points.
+//
+// Enabled by compiling with MATRIX_INSTRUMENTATION defined (cmake -DMATRIX_INSTRUMENTATION=ON).
+// Otherwise MATRIX_INSTRUMENT expands to nothing and the kernels carry no trace of it.
+//
+// Every outermost call records its shape, the entry point called, the kernel that did
+// the work (the innermost instrumented one), the wall time, the largest number of threads
+// used and the bytes requested from the matrix allocator meanwhile (by any thread, so
+// concurrent calls see each other's allocations). The calls are aggregated per
+// (entry, kernel, shape) with a log2 histogram of the durations.
+//
+// If the environment variable MATRIX_INSTRUMENTATION_OUTPUT names a file, the aggregate is
+// written there at exit: CSV if the name ends in .csv, JSON otherwise.
+
+
+// Aggregate of the calls with one (entry, kernel, shape)
+struct MultiplyCallStats {
+	std::string entry;
+	std::string kernel;
+	int rowsA = 0;
+	int colsA = 0;
+	int colsB = 0;
+
+	long long calls = 0;
+	double seconds = 0.0;
+	double min_seconds = 0.0;
+	double max_seconds = 0.0;
+	int threads = 0;
+	size_t bytes_allocated = 0;
+
+	// histogram[b] counts the calls that took less than 2^b microseconds (and at least 2^(b-1))
+	std::vector<long long> histogram;
+
+	// 2 * rowsA * colsA * colsB per call over the total time
+	double gops() const;
+};
+
+// Snapshot of the aggregates, by decreasing total time
+std::vector<MultiplyCallStats> instrumentation_stats();
+void reset_instrumentation();
+
+void dump_instrumentation_json(std::ostream &out);
+void dump_instrumentation_csv(std::ostream &out);
+
+
+// Times the call it is declared in, see MATRIX_INSTRUMENT
+class MultiplyCallScope {
+public:
+	MultiplyCallScope(const char *kernel, int rowsA, int colsA, int colsB, int threads);
+	~MultiplyCallScope();
+
+	MultiplyCallScope(const MultiplyCallScope &) = delete;
+	MultiplyCallScope &operator=(const MultiplyCallScope &) = delete;
+
+private:
+	bool m_outermost;
+	std::chrono::steady_clock::time_point m_start;
+	size_t m_allocated;
+};
+
+// Bytes requested from the matrix allocator, called by allocate_matrix_buffer
+void note_matrix_allocation(size_t bytes);
+
+
+#ifdef MATRIX_INSTRUMENTATION
+#define MATRIX_INSTRUMENT(kernel, rowsA, colsA, colsB, threads) \
+	MultiplyCallScope matrix_instrument_scope_(kernel, rowsA, colsA, colsB, threads)
+#else
+#define MATRIX_INSTRUMENT(kernel, rowsA, colsA, colsB, threads) ((void)0)
+#endif
+
+
+
+#endif // MATRIX_INSTRUMENTATION_H
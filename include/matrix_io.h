@@ -0,0 +1,151 @@
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include "dense_matrix.h"
+#include "matrix_view.h"
+
+
+/*
+
+Binary matrix files.
+
+	offset	size	field
+	0	8	magic "SE4HPCMX"
+	8	4	version (1), also the byte order marker
+	12	4	dtype (MatrixDType)
+	16	4	layout (MatrixLayout)
+	20	4	size of one element in bytes
+	24	8	rows
+	32	8	cols
+	40	8	row stride, in elements
+	48	8	col stride, in elements
+	56	8	offset of the payload from the start of the file
+	64	...	payload, starting on a 64 byte boundary
+
+The header fields and the payload are in the native byte order (and representation) of the machine
+that wrote the file: a mapped file is used in place as a MatrixView, with no parsing and no copy,
+the pages are read by the kernels on demand (the header carries the strides). A file written on a
+machine of the other byte order reads its version as 0x01000000 and is rejected as such.
+
+Every failure (missing file, bad magic, wrong dtype, truncated payload) throws std::runtime_error.
+
+*/
+
+enum class MatrixDType : uint32_t {
+	Int8 = 1,
+	Int16 = 2,
+	Int32 = 3,
+	Int64 = 4,
+	Float32 = 5,
+	Float64 = 6
+};
+
+enum class MatrixLayout : uint32_t {
+	RowMajor = 0,
+	ColMajor = 1
+};
+
+struct MatrixFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t dtype;
+	uint32_t layout;
+	uint32_t element_size;
+	uint64_t rows;
+	uint64_t cols;
+	uint64_t row_stride;
+	uint64_t col_stride;
+	uint64_t payload_offset;
+};
+
+static_assert(sizeof(MatrixFileHeader) == 64, "the matrix file header is 64 bytes");
+
+
+template <typename T> struct matrix_dtype;
+template <> struct matrix_dtype<int8_t> { static constexpr MatrixDType value = MatrixDType::Int8; };
+template <> struct matrix_dtype<int16_t> { static constexpr MatrixDType value = MatrixDType::Int16; };
+template <> struct matrix_dtype<int32_t> { static constexpr MatrixDType value = MatrixDType::Int32; };
+template <> struct matrix_dtype<long long> { static constexpr MatrixDType value = MatrixDType::Int64; };
+template <> struct matrix_dtype<float> { static constexpr MatrixDType value = MatrixDType::Float32; };
+template <> struct matrix_dtype<double> { static constexpr MatrixDType value = MatrixDType::Float64; };
+
+
+// Read only memory mapping of a matrix file, the views it hands out live as long as it does
+class MappedMatrixFile {
+public:
+	explicit MappedMatrixFile(const std::string &path);
+	~MappedMatrixFile();
+
+	MappedMatrixFile(const MappedMatrixFile &) = delete;
+	MappedMatrixFile &operator=(const MappedMatrixFile &) = delete;
+
+	const MatrixFileHeader &header() const { return *static_cast<const MatrixFileHeader *>(m_address); }
+
+	int rows() const { return static_cast<int>(header().rows); }
+	int cols() const { return static_cast<int>(header().cols); }
+	MatrixDType dtype() const { return static_cast<MatrixDType>(header().dtype); }
+
+	template <typename T>
+	MatrixView<T> view() const {
+		if (dtype() != matrix_dtype<T>::value) throw std::runtime_error(m_path + ": dtype does not match the requested view");
+
+		const MatrixFileHeader &h = header();
+		const T *data = reinterpret_cast<const T *>(static_cast<const char *>(m_address) + h.payload_offset);
+
+		return MatrixView<T>(data, rows(), cols(), static_cast<std::ptrdiff_t>(h.row_stride), static_cast<std::ptrdiff_t>(h.col_stride));
+	}
+
+private:
+	std::string m_path;
+	void *m_address = nullptr;
+	size_t m_size = 0;
+};
+
+
+// Streaming writer: the header goes out first, then the payload one line at a time, where a line
+// is a row for RowMajor and a column for ColMajor. Nothing but the current line has to be in memory.
+class MatrixFileWriter {
+public:
+	MatrixFileWriter(const std::string &path, MatrixDType dtype, int rows, int cols, MatrixLayout layout = MatrixLayout::RowMajor);
+	~MatrixFileWriter();
+
+	template <typename T>
+	void write_line(const T *line) {
+		if (matrix_dtype<T>::value != m_dtype) throw std::runtime_error(m_path + ": element type does not match the dtype of the file");
+		write_line_bytes(line, sizeof(T) * static_cast<size_t>(m_line_length));
+	}
+
+	// Checks that every line has been written and flushes the file
+	void close();
+
+private:
+	void write_line_bytes(const void *bytes, size_t size);
+
+	std::string m_path;
+	std::ofstream m_out;
+	MatrixDType m_dtype;
+	int m_lines;
+	int m_line_length;
+	int m_written = 0;
+	bool m_closed = false;
+};
+
+
+template <typename T>
+void
+save_matrix(const std::string &path, const BasicDenseMatrix<T> &M) {
+	MatrixFileWriter writer(path, matrix_dtype<T>::value, M.rows(), M.cols());
+
+	for (int i = 0; i < M.rows(); ++i) writer.write_line(M.row(i));
+
+	writer.close();
+}
+
+
+
+#endif // MATRIX_IO_H
@@ -2,9 +2,111 @@
 #define MATRIX_MULTIPLICATION_H
 
 #include <vector>
+#include "dense_matrix.h"
+#include "matrix_view.h"
 
 void multiplyMatrices(const std::vector<std::vector<int>>& A, const std::vector<std::vector<int>>& B, std::vector<std::vector<int>>& C, int rowsA, int colsA, int colsB);
 void multiplyMatricesWithoutErrors(const std::vector<std::vector<int>>& A, const std::vector<std::vector<int>>& B, std::vector<std::vector<int>>& C, int rowsA, int colsA, int colsB);
 
+// Paths of the vector of vectors multiplyMatricesWithoutErrors, picked from the shape and a sample of A
+enum class MultiplyPath {
+	Empty,		// a dimension is 0: nothing to compute (C is zeroed when colsA is 0)
+	Scalar,		// 1 x 1 times 1 x 1
+	MatrixVector,	// colsB == 1: dot products of the rows of A, read in place
+	VectorMatrix,	// rowsA == 1: rows of B accumulated in place
+	OuterProduct,	// colsA == 1: every row of C is a multiple of B[0]
+	SmallIKJ,	// below the small-size cutoff: i-k-j loop in place, no copy, no tuning cache, no thread pool
+	SparseIKJ,	// at least 3/4 of zeros in A: i-k-j loop in place, the rows of B facing a zero are skipped
+	Tuned,		// the shape has an entry in the tuning cache (see matrix_tuning.h)
+	Packed		// anything else: contiguous copies multiplied by multiplyMatricesParallel
+};
+
+struct MultiplyDispatch {
+	MultiplyPath path;
+	double zero_fraction;	// zeros among the sampled entries of A, -1 if A was not sampled
+};
+
+const char *multiply_path_name(MultiplyPath path);
+
+// The path the vector of vectors multiplyMatricesWithoutErrors takes for these operands
+// (without tuning the shape, even in autotune mode), and the one its last call on this thread took
+MultiplyDispatch choose_multiply_path(const std::vector<std::vector<int>>& A, const std::vector<std::vector<int>>& B, int rowsA, int colsA, int colsB);
+MultiplyDispatch last_multiply_dispatch();
+
+// Contiguous version, the dimensions are taken from the matrices and C is reshaped to A.rows() x B.cols() if needed
+void multiplyMatricesWithoutErrors(const DenseMatrix& A, const DenseMatrix& B, DenseMatrix& C);
+
+// Non-owning operands (e.g. memory mapped files, see matrix_io.h): views with any strides
+// (column-major, transposed) are read in place by the blocked kernel, on tiles of C run by the default thread pool
+void multiplyMatricesWithoutErrors(const MatrixView<int>& A, const MatrixView<int>& B, DenseMatrix& C);
+
+// Available multiplication engines, they all give the same results
+enum class MultiplyKernel {
+	Reference,	// textbook i-j-k triple loop
+	Blocked,	// cache-blocked with packed panels and a register-blocked micro-kernel
+	Parallel,	// blocked kernel run on 2D tiles of C by the default thread pool
+	Strassen	// Strassen-Winograd recursion with the default cutoff
+};
+
+void multiplyMatricesWithoutErrors(const DenseMatrix& A, const DenseMatrix& B, DenseMatrix& C, MultiplyKernel kernel);
+void multiplyMatricesBlocked(const DenseMatrix& A, const DenseMatrix& B, DenseMatrix& C);
+
+class ThreadPool;
+
+// Multithreaded blocked kernel, by default on default_thread_pool() (see thread_pool.h)
+void multiplyMatricesParallel(const DenseMatrix& A, const DenseMatrix& B, DenseMatrix& C);
+void multiplyMatricesParallel(const DenseMatrix& A, const DenseMatrix& B, DenseMatrix& C, ThreadPool& pool);
+
+// Matrix-vector y = A * x and vector-matrix y = x * B, bandwidth bound: the matrix is streamed once
+// along its rows, with SIMD dot products / row updates, split on the default thread pool when large.
+// The blocked and parallel engines (and the vector of vectors signature) switch to these kernels by
+// themselves when B has one column or A one row
+void multiplyMatrixVector(const DenseMatrix& A, const std::vector<int>& x, std::vector<int>& y);
+void multiplyVectorMatrix(const std::vector<int>& x, const DenseMatrix& B, std::vector<int>& y);
+
+// GEMM-style update C = alpha * A * B + beta * C (int32 wrap around), multithreaded like multiplyMatricesParallel.
+// The scaling is fused into the kernel: every element of C is read and written once per panel of K, with no
+// temporary for A * B. With beta == 0 C is only written (and reshaped if needed), otherwise it must be A.rows() x B.cols()
+void multiplyMatricesGemm(const DenseMatrix& A, const DenseMatrix& B, DenseMatrix& C, int alpha = 1, int beta = 1);
+
+// Operand flags: C = op(A) * op(B) with op(X) = X or X^T. The transpose is never built, the
+// strides are swapped instead. A * B^T with a deep inner dimension is computed as dot products of rows of A and rows of B
+enum class Transpose {
+	No,
+	Yes
+};
+
+void multiplyMatricesWithoutErrors(const DenseMatrix& A, Transpose transA, const DenseMatrix& B, Transpose transB, DenseMatrix& C);
+
+// Strassen-Winograd recursion, blocks with a dimension <= cutoff go to the blocked kernel.
+// Any shape is accepted, odd dimensions are peeled at every level
+constexpr int STRASSEN_DEFAULT_CUTOFF = 256;
+void multiplyMatricesStrassen(const DenseMatrix& A, const DenseMatrix& B, DenseMatrix& C, int cutoff = STRASSEN_DEFAULT_CUTOFF);
+
+// What multiplyMatricesChecked writes in C for the entries that do not fit in an int
+enum class OverflowPolicy {
+	Wrap,		// the low 32 bits, i.e. what the plain kernels produce
+	Saturate	// INT_MIN or INT_MAX
+};
+
+// Block of C in which at least one entry overflowed
+struct OverflowTile {
+	int row;
+	int col;
+	int rows;
+	int cols;
+};
+
+// Accumulate in int64 and narrow to int with one range check per tile of C.
+// Returns false if some entry did not fit, the offending tiles are appended to overflows if given
+bool multiplyMatricesChecked(const DenseMatrix& A, const DenseMatrix& B, DenseMatrix& C, OverflowPolicy policy, std::vector<OverflowTile>* overflows = nullptr);
+
+// Accumulate in int64 and return the exact int64 product
+void multiplyMatricesWide(const DenseMatrix& A, const DenseMatrix& B, BasicDenseMatrix<long long>& C);
+
+// Overflow-safe modes of the entry point: same as multiplyMatricesChecked and multiplyMatricesWide
+bool multiplyMatricesWithoutErrors(const DenseMatrix& A, const DenseMatrix& B, DenseMatrix& C, OverflowPolicy policy, std::vector<OverflowTile>* overflows = nullptr);
+void multiplyMatricesWithoutErrors(const DenseMatrix& A, const DenseMatrix& B, BasicDenseMatrix<long long>& C);
+
 
 #endif // MATRIX_MULTIPLICATION_H
@@ -0,0 +1,102 @@
+#ifndef MATRIX_TUNING_H
+#define MATRIX_TUNING_H
+
+
+#include <string>
+#include <vector>
+#include "dense_matrix.h"
+
+
+// Per shape tuning of the int32 multiplication.
+//
+// multiplyMatricesTuned runs a loop-tiled kernel whose tiles, loop order, unroll factor and
+// thread split are parameters. autotune_multiplication benchmarks a set of candidate
+// configurations for one shape and keeps the fastest. Winners are stored in a tuning cache
+// file keyed by CPU model, which is loaded on first use, so one file can serve several node types.
+// The vector of vectors multiplyMatricesWithoutErrors uses the tuned configuration of its shape
+// when the cache has one. With MATRIX_AUTOTUNE set it tunes the large shapes the cache lacks the
+// first time it sees them.
+//
+// The cache file is MATRIX_TUNING_CACHE if set, $HOME/.matrix_tuning_cache otherwise. Lines
+// that do not parse, or whose blocks are out of range (or not whole micro-kernel blocks for the
+// packed order), are skipped when it is loaded.
+
+
+enum class TunedLoopOrder {
+	Packed,	// GotoBLAS blocking with packed panels and the SIMD micro-kernel
+	IKJ	// plain i-k-j tiles: rows of B streamed into rows of C, no packing
+};
+
+struct TuningConfig {
+	TunedLoopOrder order = TunedLoopOrder::Packed;
+
+	// Cache blocks of A rows, depth and B columns (0 = the library defaults).
+	// Packed rounds mc and nc up to the micro-kernel block
+	int mc = 0;
+	int kc = 0;
+	int nc = 0;
+
+	// IKJ only: rows of C updated by every pass over a row of B (1, 2 or 4)
+	int unroll = 1;
+
+	// C is cut in row bands run by the default thread pool, 4 bands per thread; 1 runs serially
+	int threads = 1;
+
+	// e.g. "packed mc=128 kc=256 nc=2048 unroll=1 threads=1"
+	std::string to_string() const;
+};
+
+bool operator==(const TuningConfig &a, const TuningConfig &b);
+
+
+// C = A * B with the given configuration, any configuration gives the same result
+void multiplyMatricesTuned(const DenseMatrix &A, const DenseMatrix &B, DenseMatrix &C, const TuningConfig &config);
+
+
+// Configurations tried for a rowsA x colsA by colsA x colsB product (no duplicates)
+std::vector<TuningConfig> tuning_candidates(int rowsA, int colsA, int colsB);
+
+struct AutotuneOptions {
+	// Best of this many timed runs per candidate, after one warm up run
+	int repetitions = 3;
+
+	// Store the winner in the tuning cache file
+	bool save = true;
+};
+
+struct AutotuneResult {
+	TuningConfig config;
+	double gops = 0.0;
+};
+
+// Time every candidate on random operands of this shape and record the fastest for the current CPU.
+// Only int32 is tuned: the dtype of the cache entries is always "int32"
+AutotuneResult autotune_multiplication(int rowsA, int colsA, int colsB, const AutotuneOptions &options = {});
+
+// Tuned configuration of the shape for the current CPU, false if there is none
+bool find_tuned_config(int rowsA, int colsA, int colsB, TuningConfig &config);
+
+// Lookup used by the multiply entry points: also tunes (and saves) the shape in autotune mode
+bool tuned_config_for(int rowsA, int colsA, int colsB, TuningConfig &config);
+
+
+// Model name of the CPU (from /proc/cpuinfo), the key of the cache entries
+const std::string &cpu_model_name();
+
+// The cache file in use (a copy, safe against a concurrent change); changing it drops the
+// entries in memory and loads the new file
+std::string tuning_cache_path();
+void set_tuning_cache_path(const std::string &path);
+
+// Forget every entry in memory (the file is left alone)
+void clear_tuning_cache();
+
+// Write the entries in memory, those of the other CPUs included, to tuning_cache_path()
+void save_tuning_cache();
+
+// Entries of the current CPU in memory
+size_t tuning_cache_size();
+
+
+
+#endif // MATRIX_TUNING_H
@@ -3,10 +3,69 @@
 
 
 #include <vector>
+#include <cstdint>
+#include <type_traits>
+#include "dense_matrix.h"
 
 
 std::vector<std::vector<int>> build_empty_matrix(const int rows, const int cols);
 std::vector<std::vector<int>> build_random_matrix(const int rows, const int cols, int seed = 0);
+std::vector<std::vector<int>> build_random_matrix(const int rows, const int cols, int seed, int lo, int hi);
+
+// Contiguous builders, instantiated for int8_t, int16_t, int, long long, float and double.
+// By default integers are drawn from [-10000, 10000] clipped to the range of the type, floating point from [-1, 1]
+template <typename T>
+void build_empty_matrix(BasicDenseMatrix<T> &result, const int rows, const int cols);
+
+template <typename T>
+void build_random_matrix(BasicDenseMatrix<T> &result, const int rows, const int cols, int seed = 0);
+
+// Same with an explicit range: [lo, hi] for integers (INT_MIN, INT_MAX is fine), [lo, hi) for floating point
+template <typename T>
+void build_random_matrix(BasicDenseMatrix<T> &result, const int rows, const int cols, int seed, T lo, T hi);
+
+
+// The random builders are counter based: element (i, j) is a pure function of (seed, i, j),
+// so the matrix is the same whatever the number of threads filling it, and any tile of it
+// can be regenerated on its own with random_matrix_element.
+
+// SplitMix64 finalizer of the (seed, i, j) counter
+inline uint64_t
+random_matrix_bits(const int seed, const int i, const int j) {
+	uint64_t z = (static_cast<uint64_t>(static_cast<uint32_t>(i)) << 32) | static_cast<uint32_t>(j);
+	z += (static_cast<uint64_t>(static_cast<uint32_t>(seed)) + 1) * 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+template <typename T>
+inline T
+random_matrix_element(const int seed, const int i, const int j, const T lo, const T hi) {
+	const uint64_t bits = random_matrix_bits(seed, i, j);
+
+	if constexpr (std::is_integral<T>::value) {
+		// Multiply-shift of the high 32 bits onto the span, enough for any span up to 2^32.
+		// Everything is computed modulo 2^64, so that no signed operation can overflow
+		const uint64_t base = static_cast<uint64_t>(lo);
+		const uint64_t span = static_cast<uint64_t>(hi) - base + 1;
+
+		// The full 64-bit range wraps the span around to 0: every bit pattern is a value
+		if (span == 0) {
+			return static_cast<T>(base + bits);
+		}
+
+		if (span > (1ULL << 32)) {
+			return static_cast<T>(base + bits % span);
+		}
+
+		return static_cast<T>(base + (((bits >> 32) * span) >> 32));
+	} else {
+		// 53 random bits in [0, 1)
+		const double unit = static_cast<double>(bits >> 11) * (1.0 / 9007199254740992.0);
+		return static_cast<T>(lo + (hi - lo) * unit);
+	}
+}
 
 
 
@@ -0,0 +1,59 @@
+#ifndef MATRIX_VIEW_H
+#define MATRIX_VIEW_H
+
+
+#include <cstddef>
+#include "dense_matrix.h"
+
+
+// Non-owning, read only, strided view of a matrix: element (i,j) is data()[i*row_stride() + j*col_stride()].
+// Row-major storage has col_stride() == 1, column-major has row_stride() == 1 (so a column-major
+// view of a buffer is the transpose of the row-major one, for free).
+template <typename T>
+class MatrixView {
+public:
+	using value_type = T;
+
+	MatrixView() = default;
+
+	MatrixView(const T *data, const int rows, const int cols, const std::ptrdiff_t row_stride, const std::ptrdiff_t col_stride)
+		: m_data(data), m_rows(rows), m_cols(cols), m_row_stride(row_stride), m_col_stride(col_stride) {}
+
+	MatrixView(const BasicDenseMatrix<T> &M)
+		: MatrixView(M.data(), M.rows(), M.cols(), M.stride(), 1) {}
+
+	int rows() const { return m_rows; }
+	int cols() const { return m_cols; }
+	std::ptrdiff_t row_stride() const { return m_row_stride; }
+	std::ptrdiff_t col_stride() const { return m_col_stride; }
+	const T *data() const { return m_data; }
+
+	bool is_row_major() const { return m_col_stride == 1; }
+
+	const T &operator()(const int i, const int j) const { return m_data[i * m_row_stride + j * m_col_stride]; }
+
+	MatrixView transposed() const { return MatrixView(m_data, m_cols, m_rows, m_col_stride, m_row_stride); }
+
+	// Owning row-major copy
+	BasicDenseMatrix<T> to_dense() const {
+		BasicDenseMatrix<T> result(m_rows, m_cols);
+
+		for (int i = 0; i < m_rows; ++i) {
+			T *row = result.row(i);
+			for (int j = 0; j < m_cols; ++j) row[j] = (*this)(i, j);
+		}
+
+		return result;
+	}
+
+private:
+	const T *m_data = nullptr;
+	int m_rows = 0;
+	int m_cols = 0;
+	std::ptrdiff_t m_row_stride = 0;
+	std::ptrdiff_t m_col_stride = 0;
+};
+
+
+
+#endif // MATRIX_VIEW_H
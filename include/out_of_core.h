@@ -0,0 +1,88 @@
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+
+#include <cstdint>
+#include <string>
+#include "dense_matrix.h"
+#include "matrix_view.h"
+
+
+/*
+
+Out-of-core multiplication of int matrices stored in tiled files.
+
+A tiled file is a 64 byte header followed by the tiles in row-major tile order. Every tile is a
+full tile_rows x tile_cols row-major block of int, the tiles on the right and bottom edges are
+padded with zeros, so tile (ti, tj) is one contiguous read at a computable offset:
+
+	offset	size	field
+	0	8	magic "SE4HPCTL"
+	8	4	version (1)
+	12	4	tile rows
+	16	4	tile cols
+	20	4	reserved
+	24	8	rows
+	32	8	cols
+	40	24	reserved, the tiles start at offset 64
+
+Errors throw std::runtime_error, like the flat matrix files of matrix_io.h.
+
+*/
+
+// Random access to the tiles of a file, reads and writes are positional (pread/pwrite) so
+// several threads can use the same object at once
+class TiledMatrixFile {
+public:
+	// Open an existing file
+	explicit TiledMatrixFile(const std::string &path);
+
+	// Create (or truncate) a file for a rows x cols matrix, every tile initially zero
+	TiledMatrixFile(const std::string &path, int rows, int cols, int tile_rows, int tile_cols);
+
+	~TiledMatrixFile();
+
+	TiledMatrixFile(const TiledMatrixFile &) = delete;
+	TiledMatrixFile &operator=(const TiledMatrixFile &) = delete;
+
+	int rows() const { return m_rows; }
+	int cols() const { return m_cols; }
+	int tile_rows() const { return m_tile_rows; }
+	int tile_cols() const { return m_tile_cols; }
+	int tiles_down() const { return (m_rows + m_tile_rows - 1) / m_tile_rows; }
+	int tiles_across() const { return (m_cols + m_tile_cols - 1) / m_tile_cols; }
+
+	// tile has room for tile_rows() * tile_cols() elements
+	void read_tile(int ti, int tj, int *tile) const;
+	void write_tile(int ti, int tj, const int *tile);
+
+private:
+	int64_t tile_offset(int ti, int tj) const;
+
+	std::string m_path;
+	int m_fd = -1;
+	int m_rows = 0;
+	int m_cols = 0;
+	int m_tile_rows = 0;
+	int m_tile_cols = 0;
+};
+
+
+// Conversions from and to an in-memory matrix (any view, e.g. a mapped flat file)
+void write_tiled_matrix(const std::string &path, const MatrixView<int> &M, int tile_rows, int tile_cols);
+DenseMatrix read_tiled_matrix(const std::string &path);
+
+
+// C = A * B tile by tile, with A, B and C in tiled files. The tile columns of A must match the tile
+// rows of B, C gets tiles of A.tile_rows() x B.tile_cols().
+//
+// Only two pairs of A/B tiles, one accumulator and the C tile being written (six tiles) are in
+// memory at any time, whatever the size of the matrices: the next pair is read in the background
+// while the current one is multiplied into the accumulator (by the multithreaded GEMM update),
+// and finished C tiles are written back in the background too. The reads and writes
+// share one I/O thread, started once per call.
+void multiplyMatricesOutOfCore(const std::string &pathA, const std::string &pathB, const std::string &pathC);
+
+
+
+#endif // OUT_OF_CORE_H
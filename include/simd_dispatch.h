@@ -0,0 +1,28 @@
+#ifndef SIMD_DISPATCH_H
+#define SIMD_DISPATCH_H
+
+
+// Instruction sets of the int32 micro-kernels, from the narrowest to the widest
+enum class SimdLevel {
+	Scalar,
+	SSE41,
+	AVX2,
+	AVX512
+};
+
+
+// Widest level supported by the CPU, detected once through CPUID
+SimdLevel detected_simd_level();
+
+// Level used by the blocked kernels, the detected one unless overridden
+SimdLevel active_simd_level();
+
+// Force a level (e.g. to compare the kernels against each other).
+// A level the CPU does not support is clamped to the detected one.
+void set_simd_level(SimdLevel level);
+
+const char *simd_level_name(SimdLevel level);
+
+
+
+#endif // SIMD_DISPATCH_H
@@ -0,0 +1,81 @@
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+
+#include <vector>
+#include "dense_matrix.h"
+
+
+// Compressed sparse row: the non zeros of row i are values[row_ptr[i] .. row_ptr[i+1]),
+// in increasing column order, with their columns in col_idx
+struct CsrMatrix {
+	int rows = 0;
+	int cols = 0;
+	std::vector<int> row_ptr;
+	std::vector<int> col_idx;
+	std::vector<int> values;
+
+	int nnz() const { return static_cast<int>(values.size()); }
+};
+
+// Compressed sparse column: same as CSR on the transpose
+struct CscMatrix {
+	int rows = 0;
+	int cols = 0;
+	std::vector<int> col_ptr;
+	std::vector<int> row_idx;
+	std::vector<int> values;
+
+	int nnz() const { return static_cast<int>(values.size()); }
+};
+
+
+// Below this fraction of non zeros the sparse kernels beat the dense blocked one
+constexpr double SPARSE_DENSITY_THRESHOLD = 0.05;
+
+long long count_nonzeros(const DenseMatrix &M);
+double density(const DenseMatrix &M);
+
+CsrMatrix to_csr(const DenseMatrix &M);
+CsrMatrix to_csr(const std::vector<std::vector<int>> &M, int rows, int cols);
+CsrMatrix to_csr(const CscMatrix &M);
+CscMatrix to_csc(const DenseMatrix &M);
+CscMatrix to_csc(const CsrMatrix &M);
+DenseMatrix to_dense(const CsrMatrix &M);
+DenseMatrix to_dense(const CscMatrix &M);
+
+// Convert only if the density of M (of its leading rows x cols block) is at most max_density,
+// returns whether it did. Counting stops at the first row past the threshold
+bool to_csr_if_sparse(const DenseMatrix &M, CsrMatrix &result, double max_density = SPARSE_DENSITY_THRESHOLD);
+bool to_csr_if_sparse(const std::vector<std::vector<int>> &M, int rows, int cols, CsrMatrix &result, double max_density = SPARSE_DENSITY_THRESHOLD);
+
+
+// The kernels run over the rows of the result on the default thread pool.
+
+// SpMM: sparse times dense, C = A * B
+void multiplyMatricesSparse(const CsrMatrix &A, const DenseMatrix &B, DenseMatrix &C);
+
+// Dense times sparse, C = A * B, every entry is a dot product of a row of A with a compressed column of B
+void multiplyMatricesSparse(const DenseMatrix &A, const CscMatrix &B, DenseMatrix &C);
+
+// SpGEMM: sparse times sparse (Gustavson), the result is sparse as well
+void multiplyMatricesSparse(const CsrMatrix &A, const CsrMatrix &B, CsrMatrix &C);
+
+
+// Which operands the automatic selection stores as sparse
+enum class SparseChoice {
+	Dense,
+	SparseA,
+	SparseB,
+	SparseBoth
+};
+
+// Decide from the measured number of non zeros of A and B
+SparseChoice choose_sparse_kernel(const DenseMatrix &A, const DenseMatrix &B, double max_density = SPARSE_DENSITY_THRESHOLD);
+
+// C = A * B with the kernel picked by choose_sparse_kernel, the decision is returned in chosen if given
+void multiplyMatricesAuto(const DenseMatrix &A, const DenseMatrix &B, DenseMatrix &C, SparseChoice *chosen = nullptr);
+
+
+
+#endif // SPARSE_MATRIX_H
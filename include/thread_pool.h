@@ -0,0 +1,81 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <exception>
+
+
+// Persistent pool of worker threads running indexed loops.
+//
+// The workers are created once and sleep between jobs, so repeated small parallel_for calls
+// only pay a wake up. Every participant owns a queue of indices: it pops from the front of
+// its own queue and, once empty, steals from the back of the others, which balances ragged
+// task counts without a central counter.
+class ThreadPool {
+public:
+	// threads is the total number of participants, the calling thread included
+	explicit ThreadPool(int threads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	int size() const { return m_size; }
+
+	// Run task(i) for every i in [0, count) and return when all of them are done.
+	// If a task throws, the indices not started yet are skipped and the first exception is
+	// rethrown here once every participant has stopped, the pool stays usable.
+	// NB: a parallel_for issued from inside a task runs serially on the calling worker
+	void parallel_for(int count, const std::function<void(int)> &task);
+
+private:
+	struct Queue {
+		std::mutex mutex;
+		std::deque<int> indices;
+	};
+
+	void worker_loop(int id);
+	void run_tasks(int id);
+	bool pop(int id, int &index);
+
+	int m_size;
+	std::vector<std::thread> m_workers;
+	std::vector<std::unique_ptr<Queue>> m_queues;
+
+	// Job state, protected by m_mutex
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	const std::function<void(int)> *m_task = nullptr;
+	unsigned long m_generation = 0;
+	int m_active = 0;
+	bool m_stop = false;
+	std::exception_ptr m_error;
+
+	std::atomic<int> m_remaining{0};
+	std::atomic<bool> m_failed{false};
+
+	// Serialises parallel_for calls coming from different external threads
+	std::mutex m_submit;
+};
+
+
+// Process wide pool used by the parallel kernels. It is created on first use with
+// std::thread::hardware_concurrency() threads, or MATRIX_NUM_THREADS if that is set.
+ThreadPool &default_thread_pool();
+
+// Replace the default pool with one of the given size (<= 0 means hardware concurrency).
+// NB: must not be called while a parallel kernel is running
+void set_default_thread_count(int threads);
+
+
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,95 @@
+#ifndef TYPED_MULTIPLICATION_H
+#define TYPED_MULTIPLICATION_H
+
+
+#include <cstdint>
+#include <type_traits>
+#include "dense_matrix.h"
+#include "matrix_multiplication.h"
+
+
+// Multiplication over other element types than int.
+//
+// C = A * B where A and B hold T and the products are summed in Acc. Narrow integers
+// accumulate in int32 by default, so quantised int8 inputs do not have to be widened
+// to int in memory first.
+
+
+template <typename T> struct accumulator { using type = T; };
+template <> struct accumulator<int8_t> { using type = int32_t; };
+template <> struct accumulator<int16_t> { using type = int32_t; };
+
+template <typename T>
+using accumulator_t = typename accumulator<T>::type;
+
+
+// Type the portable kernel sums in: the unsigned counterpart (at least unsigned int) of an integral
+// Acc, so that an overflow wraps modulo 2^bits like the SIMD paths instead of being undefined
+template <typename Acc, bool = std::is_integral<Acc>::value && !std::is_same<Acc, bool>::value>
+struct wrapping_sum { using type = Acc; };
+
+template <typename Acc>
+struct wrapping_sum<Acc, true> { using type = std::make_unsigned_t<std::common_type_t<Acc, int>>; };
+
+template <typename Acc>
+using wrapping_sum_t = typename wrapping_sum<Acc>::type;
+
+
+// Portable kernel for any pair of types, i-k-j order so that the inner loop is unit stride.
+// Every entry of C still receives its terms in increasing k order. Integers wrap (see wrapping_sum)
+template <typename T, typename Acc = accumulator_t<T>>
+void multiplyMatricesGeneric(const BasicDenseMatrix<T>& A, const BasicDenseMatrix<T>& B, BasicDenseMatrix<Acc>& C) {
+	using Sum = wrapping_sum_t<Acc>;
+
+	if (C.rows() != A.rows() || C.cols() != B.cols()) C.resize(A.rows(), B.cols());
+
+	for (int i = 0; i < A.rows(); ++i) {
+		const T *a = A.row(i);
+		Acc *c = C.row(i);
+
+		for (int j = 0; j < C.cols(); ++j) c[j] = Acc(0);
+
+		for (int k = 0; k < A.cols(); ++k) {
+			const Sum ak = static_cast<Sum>(static_cast<Acc>(a[k]));
+			const T *b = B.row(k);
+
+			for (int j = 0; j < C.cols(); ++j) {
+				c[j] = static_cast<Acc>(static_cast<Sum>(c[j]) + ak * static_cast<Sum>(static_cast<Acc>(b[j])));
+			}
+		}
+	}
+}
+
+
+// Fast paths, they fall back to multiplyMatricesGeneric when the CPU lacks the instructions:
+//  * int8/int16 -> int32: pairs of k are packed as int16 and reduced with pmaddwd (AVX2)
+//    or vpdpwssd (AVX-512 VNNI), exact with the usual int32 wrap around. int8 is widened
+//    to int16 in the packed B, so it runs at the speed of int16, not twice as fast
+//  * float/double: fused multiply-add (AVX2 + FMA), so the rounding differs from the
+//    generic kernel by at most one ulp per term
+void multiplyMatricesNarrow(const BasicDenseMatrix<int8_t>& A, const BasicDenseMatrix<int8_t>& B, BasicDenseMatrix<int32_t>& C);
+void multiplyMatricesNarrow(const BasicDenseMatrix<int16_t>& A, const BasicDenseMatrix<int16_t>& B, BasicDenseMatrix<int32_t>& C);
+void multiplyMatricesFMA(const BasicDenseMatrix<float>& A, const BasicDenseMatrix<float>& B, BasicDenseMatrix<float>& C);
+void multiplyMatricesFMA(const BasicDenseMatrix<double>& A, const BasicDenseMatrix<double>& B, BasicDenseMatrix<double>& C);
+
+
+// Entry point: picks the fast path for (T, Acc) when there is one
+template <typename T, typename Acc = accumulator_t<T>>
+void multiplyMatricesTyped(const BasicDenseMatrix<T>& A, const BasicDenseMatrix<T>& B, BasicDenseMatrix<Acc>& C) {
+	constexpr bool narrow = (std::is_same<T, int8_t>::value || std::is_same<T, int16_t>::value) && std::is_same<Acc, int32_t>::value;
+	constexpr bool floating = std::is_floating_point<T>::value && std::is_same<T, Acc>::value;
+
+	if constexpr (narrow) {
+		multiplyMatricesNarrow(A, B, C);
+	} else if constexpr (floating) {
+		multiplyMatricesFMA(A, B, C);
+	} else if constexpr (std::is_same<T, int>::value && std::is_same<Acc, int>::value) {
+		multiplyMatricesBlocked(A, B, C);
+	} else {
+		multiplyMatricesGeneric<T, Acc>(A, B, C);
+	}
+}
+
+
+
+#endif // TYPED_MULTIPLICATION_H
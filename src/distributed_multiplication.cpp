@@ -0,0 +1,431 @@
+#include "distributed_multiplication.h"
+#include "matrix_multiplication.h"
+#include "matrix_utils.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+
+namespace {
+
+// Local index of global row / column g on the process that owns it, among nprocs
+int
+global_to_local(const int g, const int nb, const int nprocs) {
+	return (g / nb / nprocs) * nb + g % nb;
+}
+
+
+// Copy columns [j0, j0 + width) of M into panel
+void
+copy_columns(const DenseMatrix &M, const int j0, const int width, DenseMatrix &panel) {
+	panel.resize(M.rows(), width);
+
+	for (int i = 0; i < M.rows(); ++i) {
+		std::copy(M.row(i) + j0, M.row(i) + j0 + width, panel.row(i));
+	}
+}
+
+
+// Copy rows [i0, i0 + height) of M into panel
+void
+copy_rows(const DenseMatrix &M, const int i0, const int height, DenseMatrix &panel) {
+	panel.resize(height, M.cols());
+
+	for (int i = 0; i < height; ++i) {
+		std::copy(M.row(i0 + i), M.row(i0 + i) + M.cols(), panel.row(i));
+	}
+}
+
+
+// Matching operands on one grid, C the right shape
+void
+check_operands(const char *name, const DistributedMatrix &A, const DistributedMatrix &B, const DistributedMatrix &C) {
+	const ProcessGrid &grid = A.grid();
+	const int nb = A.block();
+
+	if (&B.grid() != &grid || &C.grid() != &grid || B.block() != nb || C.block() != nb)
+		throw std::invalid_argument(std::string(name) + ": A, B and C must share the grid and the block size");
+	if (A.cols() != B.rows() || C.rows() != A.rows() || C.cols() != B.cols())
+		throw std::invalid_argument(std::string(name) + ": dimensions do not match");
+}
+
+
+// Broadcast of count ints from root over comm, with its logical volume
+void
+broadcast(int *data, const int count, const int root, MPI_Comm comm, CommunicationStats *stats) {
+	MPI_Bcast(data, count, MPI_INT, root, comm);
+
+	if (!stats) return;
+
+	int rank, size;
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	const long long bytes = static_cast<long long>(count) * sizeof(int);
+	if (rank == root) {
+		stats->bytes_sent += bytes * (size - 1);
+		stats->messages += size - 1;
+	} else {
+		stats->bytes_received += bytes;
+	}
+}
+
+
+// Send send to dest and receive recv (already of the right shape) from source, over comm
+void
+exchange(const DenseMatrix &send, const int dest, DenseMatrix &recv, const int source, MPI_Comm comm, CommunicationStats *stats) {
+	int rank;
+	MPI_Comm_rank(comm, &rank);
+
+	if (dest == rank && source == rank) {
+		recv = send;
+		return;
+	}
+
+	const int send_count = send.rows() * send.cols();
+	const int recv_count = recv.rows() * recv.cols();
+
+	MPI_Sendrecv(send.data(), send_count, MPI_INT, dest, 0, recv.data(), recv_count, MPI_INT, source, 0, comm, MPI_STATUS_IGNORE);
+
+	if (stats) {
+		stats->bytes_sent += static_cast<long long>(send_count) * sizeof(int);
+		stats->bytes_received += static_cast<long long>(recv_count) * sizeof(int);
+		stats->messages += 1;
+	}
+}
+
+
+// Cannon steps [first, last) on a q x q grid. On entry a and b hold the local A and B of the calling process
+// (i, j), on exit C += the sum over the steps s of A(i, k) * B(k, j) with k = (i + j + s) mod q.
+// a and b are used as the shifting buffers
+void
+cannon_steps(const ProcessGrid &grid, const int K, const int nb, DenseMatrix &a, DenseMatrix &b, DenseMatrix &C,
+             const int first, const int last, CommunicationStats *stats) {
+	const int q = grid.rows();
+	const int i = grid.my_row();
+	const int j = grid.my_col();
+	auto mod = [q](int x) { return ((x % q) + q) % q; };
+
+	if (first >= last) {
+		C.fill(0);
+		return;
+	}
+
+	DenseMatrix next;
+
+	// Initial skew: A(i, j) goes to the process of row i that starts from k = j, B(i, j) likewise in column j.
+	// The row communicator is ranked by column and the column one by row
+	int k = mod(i + j + first);
+	next.resize(a.rows(), block_cyclic_extent(K, nb, k, q));
+	exchange(a, mod(j - i - first), next, k, grid.row_comm(), stats);
+	std::swap(a, next);
+
+	next.resize(block_cyclic_extent(K, nb, k, q), b.cols());
+	exchange(b, mod(i - j - first), next, k, grid.col_comm(), stats);
+	std::swap(b, next);
+
+	for (int s = first; s < last; ++s) {
+		multiplyMatricesGemm(a, b, C, 1, s == first ? 0 : 1);
+
+		if (s + 1 == last) break;
+
+		// A one step to the left, B one step up
+		k = mod(k + 1);
+		next.resize(a.rows(), block_cyclic_extent(K, nb, k, q));
+		exchange(a, mod(j - 1), next, mod(j + 1), grid.row_comm(), stats);
+		std::swap(a, next);
+
+		next.resize(block_cyclic_extent(K, nb, k, q), b.cols());
+		exchange(b, mod(i - 1), next, mod(i + 1), grid.col_comm(), stats);
+		std::swap(b, next);
+	}
+}
+
+
+// Layout of the packed local blocks of every process of the grid, as stored by the root
+// of a scatter / gather: the share of process p starts at displs[p]
+void
+block_cyclic_counts(const DistributedMatrix &M, std::vector<int> &counts, std::vector<int> &displs) {
+	const ProcessGrid &grid = M.grid();
+	const int size = grid.rows() * grid.cols();
+
+	counts.assign(size, 0);
+	displs.assign(size, 0);
+
+	for (int pr = 0; pr < grid.rows(); ++pr) {
+		for (int pc = 0; pc < grid.cols(); ++pc) {
+			const int p = grid.rank_of(pr, pc);
+			counts[p] = block_cyclic_extent(M.rows(), M.block(), pr, grid.rows()) * block_cyclic_extent(M.cols(), M.block(), pc, grid.cols());
+		}
+	}
+
+	for (int p = 1; p < size; ++p) displs[p] = displs[p - 1] + counts[p - 1];
+}
+
+
+// Visit every element of the global matrix with the position it has in the root buffer
+template <typename Visit>
+void
+for_each_packed(const DistributedMatrix &M, const std::vector<int> &displs, Visit visit) {
+	const ProcessGrid &grid = M.grid();
+	const int nb = M.block();
+
+	for (int i = 0; i < M.rows(); ++i) {
+		const int pr = (i / nb) % grid.rows();
+		const int li = global_to_local(i, nb, grid.rows());
+
+		for (int j = 0; j < M.cols(); ++j) {
+			const int pc = (j / nb) % grid.cols();
+			const int lj = global_to_local(j, nb, grid.cols());
+			const int local_cols = block_cyclic_extent(M.cols(), nb, pc, grid.cols());
+
+			visit(i, j, displs[grid.rank_of(pr, pc)] + li * local_cols + lj);
+		}
+	}
+}
+
+}
+
+
+ProcessGrid::ProcessGrid(MPI_Comm comm, int rows, int cols) {
+	int size;
+	MPI_Comm_size(comm, &size);
+
+	int dims[2] = {rows, cols};
+	if (rows <= 0 || cols <= 0) {
+		dims[0] = dims[1] = 0;
+		MPI_Dims_create(size, 2, dims);
+	}
+
+	if (dims[0] * dims[1] != size) throw std::invalid_argument("ProcessGrid: rows * cols must be the number of processes");
+
+	m_rows = dims[0];
+	m_cols = dims[1];
+
+	MPI_Comm_dup(comm, &m_comm);
+	MPI_Comm_rank(m_comm, &m_rank);
+
+	m_my_row = m_rank / m_cols;
+	m_my_col = m_rank % m_cols;
+
+	// Ranks in the row communicator are the column indices and vice versa
+	MPI_Comm_split(m_comm, m_my_row, m_my_col, &m_row_comm);
+	MPI_Comm_split(m_comm, m_my_col, m_my_row, &m_col_comm);
+}
+
+
+ProcessGrid::~ProcessGrid() {
+	MPI_Comm_free(&m_row_comm);
+	MPI_Comm_free(&m_col_comm);
+	MPI_Comm_free(&m_comm);
+}
+
+
+int
+block_cyclic_extent(const int n, const int nb, const int p, const int nprocs) {
+	const int blocks = n / nb;
+	int extent = (blocks / nprocs) * nb;
+
+	// The leftover full blocks go to the first processes, the partial one to the next
+	const int extra = blocks % nprocs;
+	if (p < extra) extent += nb;
+	else if (p == extra) extent += n % nb;
+
+	return extent;
+}
+
+
+DistributedMatrix::DistributedMatrix(const ProcessGrid &grid, int rows, int cols, int block)
+	: m_grid(&grid), m_rows(rows), m_cols(cols), m_block(block) {
+	if (block <= 0) throw std::invalid_argument("DistributedMatrix: the block size must be positive");
+
+	m_local.resize(block_cyclic_extent(rows, block, grid.my_row(), grid.rows()), block_cyclic_extent(cols, block, grid.my_col(), grid.cols()));
+}
+
+
+int
+DistributedMatrix::local_to_global_row(const int i) const {
+	return ((i / m_block) * m_grid->rows() + m_grid->my_row()) * m_block + i % m_block;
+}
+
+
+int
+DistributedMatrix::local_to_global_col(const int j) const {
+	return ((j / m_block) * m_grid->cols() + m_grid->my_col()) * m_block + j % m_block;
+}
+
+
+void
+build_random_matrix(DistributedMatrix &result, int seed) {
+	DenseMatrix &local = result.local();
+
+	for (int i = 0; i < local.rows(); ++i) {
+		const int gi = result.local_to_global_row(i);
+
+		for (int j = 0; j < local.cols(); ++j) {
+			local(i, j) = random_matrix_element(seed, gi, result.local_to_global_col(j), -10000, 10000);
+		}
+	}
+}
+
+
+void
+scatter_matrix(const DenseMatrix &global, DistributedMatrix &result, int root) {
+	const ProcessGrid &grid = result.grid();
+
+	std::vector<int> counts, displs;
+	std::vector<int> packed;
+
+	if (grid.rank() == root) {
+		block_cyclic_counts(result, counts, displs);
+		packed.resize(static_cast<size_t>(result.rows()) * result.cols());
+
+		for_each_packed(result, displs, [&](int i, int j, int at) { packed[at] = global(i, j); });
+	}
+
+	DenseMatrix &local = result.local();
+	MPI_Scatterv(packed.data(), counts.data(), displs.data(), MPI_INT, local.data(), local.rows() * local.cols(), MPI_INT, root, grid.comm());
+}
+
+
+void
+gather_matrix(const DistributedMatrix &M, DenseMatrix &global, int root) {
+	const ProcessGrid &grid = M.grid();
+
+	std::vector<int> counts, displs;
+	std::vector<int> packed;
+
+	if (grid.rank() == root) {
+		block_cyclic_counts(M, counts, displs);
+		packed.resize(static_cast<size_t>(M.rows()) * M.cols());
+	}
+
+	const DenseMatrix &local = M.local();
+	MPI_Gatherv(local.data(), local.rows() * local.cols(), MPI_INT, packed.data(), counts.data(), displs.data(), MPI_INT, root, grid.comm());
+
+	if (grid.rank() == root) {
+		global.resize(M.rows(), M.cols());
+		for_each_packed(M, displs, [&](int i, int j, int at) { global(i, j) = packed[at]; });
+	}
+}
+
+
+void
+multiplyMatricesSumma(const DistributedMatrix &A, const DistributedMatrix &B, DistributedMatrix &C, CommunicationStats *stats) {
+	check_operands("multiplyMatricesSumma", A, B, C);
+
+	const ProcessGrid &grid = A.grid();
+	const int nb = A.block();
+	const int K = A.cols();
+	const int steps = (K + nb - 1) / nb;
+
+	DenseMatrix &localC = C.local();
+	const int local_rows = localC.rows();
+	const int local_cols = localC.cols();
+
+	if (steps == 0) localC.fill(0);
+
+	DenseMatrix panelA, panelB;
+
+	for (int k = 0; k < steps; ++k) {
+		const int width = std::min(nb, K - k * nb);
+		const int owner_col = k % grid.cols();
+		const int owner_row = k % grid.rows();
+
+		// Block column k of A, from the process column that owns it to the whole process row
+		if (grid.my_col() == owner_col) copy_columns(A.local(), (k / grid.cols()) * nb, width, panelA);
+		else panelA.resize(local_rows, width);
+		broadcast(panelA.data(), local_rows * width, owner_col, grid.row_comm(), stats);
+
+		// Block row k of B, down the process columns
+		if (grid.my_row() == owner_row) copy_rows(B.local(), (k / grid.rows()) * nb, width, panelB);
+		else panelB.resize(width, local_cols);
+		broadcast(panelB.data(), width * local_cols, owner_row, grid.col_comm(), stats);
+
+		multiplyMatricesGemm(panelA, panelB, localC, 1, k == 0 ? 0 : 1);
+	}
+}
+
+
+void
+multiplyMatricesCannon(const DistributedMatrix &A, const DistributedMatrix &B, DistributedMatrix &C, CommunicationStats *stats) {
+	check_operands("multiplyMatricesCannon", A, B, C);
+
+	const ProcessGrid &grid = A.grid();
+	if (grid.rows() != grid.cols()) throw std::invalid_argument("multiplyMatricesCannon: the process grid must be square");
+
+	DenseMatrix a = A.local(), b = B.local();
+	cannon_steps(grid, A.cols(), A.block(), a, b, C.local(), 0, grid.rows(), stats);
+}
+
+
+LayeredProcessGrid::LayeredProcessGrid(MPI_Comm comm, int layers)
+	: m_layers(layers) {
+	int size, rank;
+	MPI_Comm_size(comm, &size);
+	MPI_Comm_rank(comm, &rank);
+
+	int q = 0;
+	if (layers > 0) {
+		while ((q + 1) * (q + 1) * layers <= size) ++q;
+	}
+
+	if (layers <= 0 || q * q * layers != size || q < layers)
+		throw std::invalid_argument("LayeredProcessGrid: the number of processes must be q * q * layers with q >= layers");
+
+	m_layer = rank / (q * q);
+	const int in_layer = rank % (q * q);
+
+	MPI_Comm layer_comm;
+	MPI_Comm_split(comm, m_layer, in_layer, &layer_comm);
+	m_layer_grid = std::make_unique<ProcessGrid>(layer_comm, q, q);
+	MPI_Comm_free(&layer_comm);
+
+	MPI_Comm_split(comm, in_layer, m_layer, &m_depth_comm);
+}
+
+
+LayeredProcessGrid::~LayeredProcessGrid() {
+	m_layer_grid.reset();
+	MPI_Comm_free(&m_depth_comm);
+}
+
+
+void
+multiplyMatrices25D(const LayeredProcessGrid &grid, const DistributedMatrix &A, const DistributedMatrix &B, DistributedMatrix &C, CommunicationStats *stats) {
+	check_operands("multiplyMatrices25D", A, B, C);
+
+	const ProcessGrid &layer = grid.layer_grid();
+	if (&A.grid() != &layer) throw std::invalid_argument("multiplyMatrices25D: the matrices must be distributed on layer_grid()");
+
+	const int q = layer.rows();
+	const int c = grid.layers();
+
+	// Replicate the layer 0 blocks along the depth
+	DenseMatrix a = A.local(), b = B.local();
+	broadcast(a.data(), a.rows() * a.cols(), 0, grid.depth_comm(), stats);
+	broadcast(b.data(), b.rows() * b.cols(), 0, grid.depth_comm(), stats);
+
+	// Layer l takes its share of the q steps
+	const int first = grid.layer() * q / c;
+	const int last = (grid.layer() + 1) * q / c;
+	cannon_steps(layer, A.cols(), A.block(), a, b, C.local(), first, last, stats);
+
+	// Sum of the partial products on layer 0
+	DenseMatrix &localC = C.local();
+	const int count = localC.rows() * localC.cols();
+
+	if (grid.layer() == 0) MPI_Reduce(MPI_IN_PLACE, localC.data(), count, MPI_INT, MPI_SUM, 0, grid.depth_comm());
+	else MPI_Reduce(localC.data(), nullptr, count, MPI_INT, MPI_SUM, 0, grid.depth_comm());
+
+	if (stats) {
+		const long long bytes = static_cast<long long>(count) * sizeof(int);
+		if (grid.layer() == 0) {
+			stats->bytes_received += bytes * (c - 1);
+		} else {
+			stats->bytes_sent += bytes;
+			stats->messages += 1;
+		}
+	}
+}
@@ -0,0 +1,182 @@
+#include "matrix_allocator.h"
+#include "matrix_instrumentation.h"
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <algorithm>
+
+
+namespace {
+
+size_t
+round_up(const size_t bytes) {
+	return (bytes + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+}
+
+
+void *
+system_allocate(const size_t bytes) {
+	void *block = std::aligned_alloc(MATRIX_ALIGNMENT, bytes);
+	if (!block) throw std::bad_alloc();
+	return block;
+}
+
+}
+
+
+BufferPool::~BufferPool() {
+	trim();
+}
+
+
+void *
+BufferPool::acquire(size_t bytes) {
+	bytes = round_up(std::max<size_t>(bytes, 1));
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto found = m_free.find(bytes);
+		if (found != m_free.end() && !found->second.empty()) {
+			void *block = found->second.back();
+			found->second.pop_back();
+			m_stats.cached_bytes -= bytes;
+			++m_stats.hits;
+			return block;
+		}
+
+		++m_stats.misses;
+	}
+
+	return system_allocate(bytes);
+}
+
+
+void
+BufferPool::release(void *block, size_t bytes) {
+	bytes = round_up(std::max<size_t>(bytes, 1));
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_stats.cached_bytes + bytes <= MATRIX_POOL_MAX_CACHED) {
+			m_free[bytes].push_back(block);
+			m_stats.cached_bytes += bytes;
+			return;
+		}
+	}
+
+	std::free(block);
+}
+
+
+void
+BufferPool::trim() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto &entry : m_free) {
+		for (void *block : entry.second) std::free(block);
+	}
+
+	m_free.clear();
+	m_stats.cached_bytes = 0;
+}
+
+
+BufferPoolStats
+BufferPool::stats() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+
+BufferPool &
+default_buffer_pool() {
+	static BufferPool *pool = new BufferPool();
+	return *pool;
+}
+
+
+MatrixArena::MatrixArena(size_t chunk_bytes)
+	: m_chunk_bytes(round_up(std::max<size_t>(chunk_bytes, MATRIX_ALIGNMENT))) {}
+
+
+MatrixArena::~MatrixArena() {
+	for (const Chunk &chunk : m_chunks) std::free(chunk.base);
+}
+
+
+void *
+MatrixArena::allocate(size_t bytes) {
+	bytes = round_up(std::max<size_t>(bytes, 1));
+
+	// First chunk from the current one on with enough room left, the skipped tails stay unused until a rewind
+	while (m_chunk < m_chunks.size()) {
+		if (m_chunks[m_chunk].size - m_offset >= bytes) {
+			void *block = m_chunks[m_chunk].base + m_offset;
+			m_offset += bytes;
+			return block;
+		}
+
+		++m_chunk;
+		m_offset = 0;
+	}
+
+	const size_t size = std::max(bytes, m_chunk_bytes);
+	m_chunks.push_back({static_cast<char *>(system_allocate(size)), size});
+
+	m_chunk = m_chunks.size() - 1;
+	m_offset = bytes;
+	return m_chunks.back().base;
+}
+
+
+void
+MatrixArena::rewind(const Mark &mark) {
+	m_chunk = mark.chunk;
+	m_offset = mark.offset;
+}
+
+
+size_t
+MatrixArena::used() const {
+	size_t total = m_offset;
+	for (size_t c = 0; c < m_chunk && c < m_chunks.size(); ++c) total += m_chunks[c].size;
+	return total;
+}
+
+
+size_t
+MatrixArena::capacity() const {
+	size_t total = 0;
+	for (const Chunk &chunk : m_chunks) total += chunk.size;
+	return total;
+}
+
+
+ArenaScope::ArenaScope(MatrixArena &arena)
+	: m_arena(arena), m_mark(arena.mark()) {}
+
+
+ArenaScope::~ArenaScope() {
+	m_arena.rewind(m_mark);
+}
+
+
+void *
+allocate_matrix_buffer(const size_t bytes, MatrixArena *arena) {
+#ifdef MATRIX_INSTRUMENTATION
+	note_matrix_allocation(bytes);
+#endif
+
+	return arena ? arena->allocate(bytes) : default_buffer_pool().acquire(bytes);
+}
+
+
+void
+deallocate_matrix_buffer(void *block, const size_t bytes, MatrixArena *arena) {
+	// Arena blocks are reclaimed all together by a rewind
+	if (!block || arena) return;
+
+	default_buffer_pool().release(block, bytes);
+}
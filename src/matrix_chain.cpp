@@ -0,0 +1,189 @@
+#include "matrix_chain.h"
+#include "matrix_multiplication.h"
+#include "sparse_matrix.h"
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <memory>
+
+
+namespace {
+
+// Expected density of the product of an m x k and a k x n matrix with independent non zeros:
+// an entry is zero only if all its k terms are
+double
+product_density(const int k, const double densityA, const double densityB) {
+	return 1.0 - std::pow(1.0 - densityA * densityB, k);
+}
+
+
+void
+to_string(const ChainPlan &plan, const int i, const int j, std::string &out) {
+	if (i == j) {
+		out += "M" + std::to_string(i);
+		return;
+	}
+
+	out += "(";
+	to_string(plan, i, plan.split[i][j], out);
+	out += " ";
+	to_string(plan, plan.split[i][j] + 1, j, out);
+	out += ")";
+}
+
+
+// Free list of partial product buffers, a released buffer keeps its allocation for the next step
+class TemporaryPool {
+public:
+	DenseMatrix *acquire(const int rows, const int cols) {
+		const size_t needed = static_cast<size_t>(rows) * cols;
+
+		// Prefer a buffer that is already big enough, otherwise grow the largest one
+		auto best = m_free.end();
+		for (auto it = m_free.begin(); it != m_free.end(); ++it) {
+			if (best == m_free.end()) best = it;
+			else if ((*it)->capacity() >= needed && ((*best)->capacity() < needed || (*it)->capacity() < (*best)->capacity())) best = it;
+			else if ((*best)->capacity() < needed && (*it)->capacity() > (*best)->capacity()) best = it;
+		}
+
+		DenseMatrix *buffer;
+		if (best != m_free.end()) {
+			buffer = *best;
+			m_free.erase(best);
+		} else {
+			m_owned.emplace_back(new DenseMatrix());
+			buffer = m_owned.back().get();
+		}
+
+		buffer->resize(rows, cols);
+		return buffer;
+	}
+
+	void release(DenseMatrix *buffer) { m_free.push_back(buffer); }
+
+	bool owns(const DenseMatrix *buffer) const {
+		for (const auto &owned : m_owned)
+			if (owned.get() == buffer) return true;
+		return false;
+	}
+
+private:
+	std::vector<std::unique_ptr<DenseMatrix>> m_owned;
+	std::vector<DenseMatrix *> m_free;
+};
+
+
+struct ChainEvaluation {
+	const std::vector<const DenseMatrix *> &matrices;
+	const ChainPlan &plan;
+	const bool sparse;
+	DenseMatrix &result;
+	TemporaryPool pool;
+
+	const DenseMatrix *evaluate(const int i, const int j) {
+		if (i == j) return matrices[i];
+
+		const int s = plan.split[i][j];
+		const DenseMatrix *left = evaluate(i, s);
+		const DenseMatrix *right = evaluate(s + 1, j);
+
+		const bool outermost = i == 0 && j == static_cast<int>(matrices.size()) - 1;
+		DenseMatrix *out = outermost ? &result : pool.acquire(left->rows(), right->cols());
+
+		if (sparse) multiplyMatricesAuto(*left, *right, *out);
+		else multiplyMatricesParallel(*left, *right, *out);
+
+		// The operands are not needed anymore: their buffers go back to the pool
+		for (const DenseMatrix *operand : {left, right})
+			if (pool.owns(operand)) pool.release(const_cast<DenseMatrix *>(operand));
+
+		return out;
+	}
+};
+
+}
+
+
+double
+dense_chain_cost(int m, int k, int n, double, double) {
+	return 2.0 * m * k * n;
+}
+
+
+double
+sparse_chain_cost(int m, int k, int n, double densityA, double densityB) {
+	return 2.0 * m * k * n * std::min({densityA, densityB, 1.0});
+}
+
+
+std::string
+ChainPlan::to_string() const {
+	std::string out;
+	if (!split.empty()) ::to_string(*this, 0, static_cast<int>(split.size()) - 1, out);
+	return out;
+}
+
+
+ChainPlan
+plan_matrix_chain(const std::vector<int> &dims, const std::vector<double> &densities, const ChainCostModel &model) {
+	const int n = static_cast<int>(dims.size()) - 1;
+
+	ChainPlan plan;
+	if (n <= 0) return plan;
+
+	plan.split.assign(n, std::vector<int>(n, 0));
+
+	std::vector<std::vector<double>> cost(n, std::vector<double>(n, 0.0));
+	std::vector<std::vector<double>> dens(n, std::vector<double>(n, 1.0));
+
+	for (int i = 0; i < n; ++i) dens[i][i] = densities.empty() ? 1.0 : densities[i];
+
+	// Subchains by increasing length, every split point is tried
+	for (int length = 2; length <= n; ++length) {
+		for (int i = 0; i + length - 1 < n; ++i) {
+			const int j = i + length - 1;
+			cost[i][j] = std::numeric_limits<double>::infinity();
+
+			for (int s = i; s < j; ++s) {
+				const double c = cost[i][s] + cost[s + 1][j] + model(dims[i], dims[s + 1], dims[j + 1], dens[i][s], dens[s + 1][j]);
+
+				if (c < cost[i][j]) {
+					cost[i][j] = c;
+					plan.split[i][j] = s;
+					dens[i][j] = product_density(dims[s + 1], dens[i][s], dens[s + 1][j]);
+				}
+			}
+		}
+	}
+
+	plan.cost = cost[0][n - 1];
+	return plan;
+}
+
+
+void
+multiplyChain(const std::vector<const DenseMatrix *> &matrices, DenseMatrix &result, const ChainOptions &options, ChainPlan *plan) {
+	if (matrices.empty()) throw std::invalid_argument("multiplyChain: empty chain");
+
+	std::vector<int> dims;
+	std::vector<double> densities;
+
+	dims.push_back(matrices[0]->rows());
+	for (const DenseMatrix *M : matrices) {
+		if (M->rows() != dims.back()) throw std::invalid_argument("multiplyChain: inner dimensions do not match");
+		dims.push_back(M->cols());
+		if (options.sparsity_aware) densities.push_back(density(*M));
+	}
+
+	const ChainPlan chosen = options.sparsity_aware ? plan_matrix_chain(dims, densities, sparse_chain_cost) : plan_matrix_chain(dims);
+	if (plan) *plan = chosen;
+
+	if (matrices.size() == 1) {
+		result = *matrices[0];
+		return;
+	}
+
+	ChainEvaluation evaluation{matrices, chosen, options.sparsity_aware, result, {}};
+	evaluation.evaluate(0, static_cast<int>(matrices.size()) - 1);
+}
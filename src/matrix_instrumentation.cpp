@@ -0,0 +1,209 @@
+#include "matrix_instrumentation.h"
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <tuple>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <algorithm>
+
+
+namespace {
+
+using CallKey = std::tuple<std::string, std::string, int, int, int>;
+
+
+// The call being timed on this thread, filled in by the nested scopes
+struct ActiveCall {
+	const char *entry = nullptr;
+	const char *kernel = nullptr;
+	int rowsA = 0;
+	int colsA = 0;
+	int colsB = 0;
+	int threads = 0;
+	int depth = 0;
+};
+
+thread_local ActiveCall active_call;
+
+std::atomic<size_t> allocated_bytes{0};
+
+
+void dump_at_exit();
+
+
+struct Registry {
+	std::mutex mutex;
+	std::map<CallKey, MultiplyCallStats> calls;
+	bool exit_dump_registered = false;
+
+	void record(const ActiveCall &call, const double seconds, const size_t bytes) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!exit_dump_registered) {
+			exit_dump_registered = true;
+			if (std::getenv("MATRIX_INSTRUMENTATION_OUTPUT")) std::atexit(dump_at_exit);
+		}
+
+		MultiplyCallStats &stats = calls[CallKey(call.entry, call.kernel, call.rowsA, call.colsA, call.colsB)];
+		if (stats.calls == 0) {
+			stats.entry = call.entry;
+			stats.kernel = call.kernel;
+			stats.rowsA = call.rowsA;
+			stats.colsA = call.colsA;
+			stats.colsB = call.colsB;
+			stats.min_seconds = seconds;
+		}
+
+		++stats.calls;
+		stats.seconds += seconds;
+		stats.min_seconds = std::min(stats.min_seconds, seconds);
+		stats.max_seconds = std::max(stats.max_seconds, seconds);
+		stats.threads = std::max(stats.threads, call.threads);
+		stats.bytes_allocated += bytes;
+
+		const double micros = seconds * 1e6;
+		const size_t bucket = micros < 1.0 ? 0 : static_cast<size_t>(std::floor(std::log2(micros))) + 1;
+		if (stats.histogram.size() <= bucket) stats.histogram.resize(bucket + 1, 0);
+		++stats.histogram[bucket];
+	}
+};
+
+
+// Leaked, so that the calls made by other static destructors still find it
+Registry &
+registry() {
+	static Registry *instance = new Registry();
+	return *instance;
+}
+
+
+bool
+ends_with(const std::string &text, const std::string &suffix) {
+	return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+void
+dump_at_exit() {
+	const char *path = std::getenv("MATRIX_INSTRUMENTATION_OUTPUT");
+	if (!path) return;
+
+	std::ofstream out(path);
+	if (!out) return;
+
+	if (ends_with(path, ".csv")) dump_instrumentation_csv(out);
+	else dump_instrumentation_json(out);
+}
+
+}
+
+
+double
+MultiplyCallStats::gops() const {
+	if (seconds <= 0.0) return 0.0;
+	return 2.0 * rowsA * colsA * colsB * calls / seconds * 1e-9;
+}
+
+
+std::vector<MultiplyCallStats>
+instrumentation_stats() {
+	std::vector<MultiplyCallStats> result;
+
+	{
+		Registry &reg = registry();
+		std::lock_guard<std::mutex> lock(reg.mutex);
+		for (const auto &entry : reg.calls) result.push_back(entry.second);
+	}
+
+	std::stable_sort(result.begin(), result.end(), [](const MultiplyCallStats &a, const MultiplyCallStats &b) {
+		return a.seconds > b.seconds;
+	});
+	return result;
+}
+
+
+void
+reset_instrumentation() {
+	Registry &reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	reg.calls.clear();
+}
+
+
+void
+dump_instrumentation_json(std::ostream &out) {
+	const std::vector<MultiplyCallStats> stats = instrumentation_stats();
+
+	out << "{\n  \"calls\": [";
+	for (size_t s = 0; s < stats.size(); ++s) {
+		const MultiplyCallStats &call = stats[s];
+
+		out << (s ? ",\n" : "\n")
+			<< "    {\"entry\": \"" << call.entry << "\", \"kernel\": \"" << call.kernel << "\""
+			<< ", \"rowsA\": " << call.rowsA << ", \"colsA\": " << call.colsA << ", \"colsB\": " << call.colsB
+			<< ", \"calls\": " << call.calls << ", \"seconds\": " << call.seconds
+			<< ", \"min_seconds\": " << call.min_seconds << ", \"max_seconds\": " << call.max_seconds
+			<< ", \"gops\": " << call.gops() << ", \"threads\": " << call.threads
+			<< ", \"bytes_allocated\": " << call.bytes_allocated << ", \"histogram_us\": {";
+
+		bool first = true;
+		for (size_t b = 0; b < call.histogram.size(); ++b) {
+			if (!call.histogram[b]) continue;
+			out << (first ? "" : ", ") << "\"<" << (1ull << b) << "\": " << call.histogram[b];
+			first = false;
+		}
+		out << "}}";
+	}
+	out << "\n  ]\n}\n";
+}
+
+
+void
+dump_instrumentation_csv(std::ostream &out) {
+	out << "entry,kernel,rowsA,colsA,colsB,calls,seconds,min_seconds,max_seconds,gops,threads,bytes_allocated\n";
+
+	for (const MultiplyCallStats &call : instrumentation_stats()) {
+		out << call.entry << ',' << call.kernel << ','
+			<< call.rowsA << ',' << call.colsA << ',' << call.colsB << ','
+			<< call.calls << ',' << call.seconds << ',' << call.min_seconds << ',' << call.max_seconds << ','
+			<< call.gops() << ',' << call.threads << ',' << call.bytes_allocated << '\n';
+	}
+}
+
+
+MultiplyCallScope::MultiplyCallScope(const char *kernel, const int rowsA, const int colsA, const int colsB, const int threads)
+	: m_outermost(active_call.depth == 0), m_allocated(0) {
+	++active_call.depth;
+
+	if (m_outermost) {
+		active_call.entry = kernel;
+		active_call.rowsA = rowsA;
+		active_call.colsA = colsA;
+		active_call.colsB = colsB;
+		active_call.threads = 0;
+		m_allocated = allocated_bytes.load(std::memory_order_relaxed);
+		m_start = std::chrono::steady_clock::now();
+	}
+
+	active_call.kernel = kernel;
+	active_call.threads = std::max(active_call.threads, threads);
+}
+
+
+MultiplyCallScope::~MultiplyCallScope() {
+	--active_call.depth;
+	if (!m_outermost) return;
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+	const size_t bytes = allocated_bytes.load(std::memory_order_relaxed) - m_allocated;
+
+	registry().record(active_call, seconds, bytes);
+}
+
+
+void
+note_matrix_allocation(const size_t bytes) {
+	allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
@@ -0,0 +1,175 @@
+#include "matrix_io.h"
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace {
+
+const char MAGIC[8] = {'S', 'E', '4', 'H', 'P', 'C', 'M', 'X'};
+constexpr uint32_t VERSION = 1;
+constexpr uint64_t PAYLOAD_ALIGNMENT = 64;
+
+
+size_t
+element_size(const MatrixDType dtype) {
+	switch (dtype) {
+	case MatrixDType::Int8: return 1;
+	case MatrixDType::Int16: return 2;
+	case MatrixDType::Int32: return 4;
+	case MatrixDType::Int64: return 8;
+	case MatrixDType::Float32: return 4;
+	case MatrixDType::Float64: return 8;
+	}
+
+	return 0;
+}
+
+
+// VERSION as read on a machine of the other byte order
+constexpr uint32_t SWAPPED_VERSION = VERSION << 24;
+
+
+// a * b and a + b, false when the result does not fit in 64 bits
+bool
+checked_mul(const uint64_t a, const uint64_t b, uint64_t &result) {
+	if (a != 0 && b > UINT64_MAX / a) return false;
+	result = a * b;
+	return true;
+}
+
+
+bool
+checked_add(const uint64_t a, const uint64_t b, uint64_t &result) {
+	if (b > UINT64_MAX - a) return false;
+	result = a + b;
+	return true;
+}
+
+
+// Whether every element addressed by the header lies in the first size bytes of the file.
+// Every term is checked, so that a crafted header cannot wrap around and pass
+bool
+payload_fits(const MatrixFileHeader &h, const uint64_t size) {
+	if (h.payload_offset > size) return false;
+	if (h.rows == 0 || h.cols == 0) return true;
+
+	uint64_t row_part, col_part, last, bytes, end;
+	return checked_mul(h.rows - 1, h.row_stride, row_part)
+		&& checked_mul(h.cols - 1, h.col_stride, col_part)
+		&& checked_add(row_part, col_part, last)
+		&& checked_add(last, 1, last)
+		&& checked_mul(last, h.element_size, bytes)
+		&& checked_add(h.payload_offset, bytes, end)
+		&& end <= size;
+}
+
+}
+
+
+MappedMatrixFile::MappedMatrixFile(const std::string &path)
+	: m_path(path) {
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) throw std::runtime_error(path + ": cannot open: " + std::strerror(errno));
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(MatrixFileHeader)) {
+		::close(fd);
+		throw std::runtime_error(path + ": too small to be a matrix file");
+	}
+
+	m_size = static_cast<size_t>(st.st_size);
+	m_address = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (m_address == MAP_FAILED) {
+		m_address = nullptr;
+		throw std::runtime_error(path + ": mmap failed: " + std::strerror(errno));
+	}
+
+	const MatrixFileHeader &h = header();
+	const char *error = nullptr;
+
+	if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) error = "not a matrix file";
+	else if (h.version == SWAPPED_VERSION) error = "written on a machine of the other byte order";
+	else if (h.version != VERSION) error = "unsupported version";
+	else if (element_size(static_cast<MatrixDType>(h.dtype)) == 0 || element_size(static_cast<MatrixDType>(h.dtype)) != h.element_size) error = "unknown dtype";
+	else if (h.layout != static_cast<uint32_t>(MatrixLayout::RowMajor) && h.layout != static_cast<uint32_t>(MatrixLayout::ColMajor)) error = "unknown layout";
+	else if (h.rows > INT_MAX || h.cols > INT_MAX) error = "dimensions do not fit in an int";
+	else if (h.payload_offset % PAYLOAD_ALIGNMENT != 0 || !payload_fits(h, m_size)) error = "truncated or misaligned payload";
+
+	if (error) {
+		::munmap(m_address, m_size);
+		m_address = nullptr;
+		throw std::runtime_error(path + ": " + error);
+	}
+
+	// The kernels walk the payload front to back
+	::madvise(m_address, m_size, MADV_SEQUENTIAL);
+}
+
+
+MappedMatrixFile::~MappedMatrixFile() {
+	if (m_address) ::munmap(m_address, m_size);
+}
+
+
+MatrixFileWriter::MatrixFileWriter(const std::string &path, MatrixDType dtype, int rows, int cols, MatrixLayout layout)
+	: m_path(path), m_out(path, std::ios::binary | std::ios::trunc), m_dtype(dtype) {
+	if (!m_out) throw std::runtime_error(path + ": cannot open for writing");
+
+	const bool row_major = layout == MatrixLayout::RowMajor;
+	m_lines = row_major ? rows : cols;
+	m_line_length = row_major ? cols : rows;
+
+	MatrixFileHeader h;
+	std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+	h.version = VERSION;
+	h.dtype = static_cast<uint32_t>(dtype);
+	h.layout = static_cast<uint32_t>(layout);
+	h.element_size = static_cast<uint32_t>(element_size(dtype));
+	h.rows = static_cast<uint64_t>(rows);
+	h.cols = static_cast<uint64_t>(cols);
+	h.row_stride = row_major ? static_cast<uint64_t>(cols) : 1;
+	h.col_stride = row_major ? 1 : static_cast<uint64_t>(rows);
+	h.payload_offset = sizeof(MatrixFileHeader);
+
+	m_out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+	if (!m_out) throw std::runtime_error(path + ": write failed");
+}
+
+
+MatrixFileWriter::~MatrixFileWriter() {
+	// NB: no close() here, a destructor must not throw for an incomplete file
+	if (!m_closed) m_out.close();
+}
+
+
+void
+MatrixFileWriter::write_line_bytes(const void *bytes, size_t size) {
+	if (m_closed) throw std::runtime_error(m_path + ": write after close");
+	if (m_written == m_lines) throw std::runtime_error(m_path + ": more lines than the matrix has");
+
+	m_out.write(static_cast<const char *>(bytes), static_cast<std::streamsize>(size));
+	if (!m_out) throw std::runtime_error(m_path + ": write failed");
+
+	++m_written;
+}
+
+
+void
+MatrixFileWriter::close() {
+	if (m_closed) return;
+
+	if (m_written != m_lines) throw std::runtime_error(m_path + ": " + std::to_string(m_written) + " of " + std::to_string(m_lines) + " lines written");
+
+	m_out.flush();
+	m_out.close();
+	m_closed = true;
+
+	if (m_out.fail()) throw std::runtime_error(m_path + ": flush failed");
+}
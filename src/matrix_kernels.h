@@ -0,0 +1,92 @@
+#ifndef MATRIX_KERNELS_H
+#define MATRIX_KERNELS_H
+
+#include <cstddef>
+#include <functional>
+#include "dense_matrix.h"
+
+class ThreadPool;
+
+// Internal raw-pointer kernels shared by the multiply engines, not part of the public API.
+// All matrices are row-major, ld* is the row stride in elements.
+
+// Register block of the micro-kernel: it produces an MR x NR tile of C
+constexpr int GEMM_MR = 4;
+constexpr int GEMM_NR = 16;
+
+// Cache blocks: an MC x KC panel of A stays in L2, a KC x NR sliver of B in L1
+constexpr int GEMM_MC = 128;
+constexpr int GEMM_KC = 256;
+constexpr int GEMM_NC = 2048;
+
+// x * y modulo 2^32, without the undefined behaviour of a signed overflow
+inline int wrapMul(int x, int y) {
+  return static_cast<int>(static_cast<unsigned>(x) * static_cast<unsigned>(y));
+}
+
+// Micro-kernel: C[0:MR,0:NR] (+)= a * b, where a is a packed MR x kc sliver of A
+// (a[p*MR + i]) and b a packed kc x NR sliver of B (b[p*NR + j])
+using MicroKernel = void (*)(int kc, const int *a, const int *b, int *C,
+                             std::ptrdiff_t ldc, bool accumulate);
+
+// Kernel of the currently active SIMD level, see simd_dispatch.h
+MicroKernel activeMicroKernel();
+
+// C[0:M,0:N] = alpha * A[0:M,0:K] * B[0:K,0:N] + beta * C[0:M,0:N], with the
+// int32 wrap around of the other kernels. alpha is folded into the packing of
+// A and beta applied to every tile of C right before its first micro-kernel
+// call, so C is not read at all when beta == 0
+void gemmBlocked(const int *A, std::ptrdiff_t lda, const int *B,
+                 std::ptrdiff_t ldb, int *C, std::ptrdiff_t ldc, int M, int N,
+                 int K, int alpha = 1, int beta = 0);
+
+// Same with arbitrary strides: element (i, j) of A is A[i*rsa + j*csa], and
+// likewise for B, so transposed operands are read in place by the packing
+void gemmStrided(const int *A, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+                 const int *B, std::ptrdiff_t rsb, std::ptrdiff_t csb, int *C,
+                 std::ptrdiff_t ldc, int M, int N, int K, int alpha = 1,
+                 int beta = 0);
+
+// Cache blocks of gemmStrided, mc a multiple of MR and nc of NR
+struct GemmBlocking {
+  int mc = GEMM_MC;
+  int kc = GEMM_KC;
+  int nc = GEMM_NC;
+};
+
+void gemmStrided(const int *A, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+                 const int *B, std::ptrdiff_t rsb, std::ptrdiff_t csb, int *C,
+                 std::ptrdiff_t ldc, int M, int N, int K, int alpha, int beta,
+                 const GemmBlocking &blocking);
+
+// C[0:M,0:N] = alpha * A * Bt^T + beta * C where Bt is N x K row-major: every
+// entry of C is the dot product of two contiguous rows
+void gemmRowDot(const int *A, std::ptrdiff_t lda, const int *Bt,
+                std::ptrdiff_t ldbt, int *C, std::ptrdiff_t ldc, int M, int N,
+                int K, int alpha = 1, int beta = 0);
+
+// C = A * B, tiled i-k-j over row pointers: a[i] is row i of the M x K matrix
+// A, b[k] row k of B, c[i] row i of C, so that any row storage is read and
+// written in place. MC x KC x NC tiles, `unroll` (1, 2 or 4) rows of C per
+// pass over a row of B. With skipZeros the zero entries of A are skipped,
+// i.e. their row of B is not read at all
+void gemmRowsIKJ(const int *const *a, const int *const *b, int *const *c,
+                 int M, int N, int K, int MC, int KC, int NC, int unroll,
+                 bool skipZeros);
+
+// Row i of a matrix, whatever its storage (dense rows or a vector of vectors)
+using RowAccessor = std::function<const int *(int)>;
+
+// y[0:M] = A * x[0:K] and y[0:N] = x[0:K] * B, reading the matrix once along
+// its rows. Large products are split on pool, nullptr runs them serially
+void gemvRows(const RowAccessor &rowA, const int *x, int *y, int M, int K,
+              ThreadPool *pool);
+void gevmRows(const int *x, const RowAccessor &rowB, int *y, int K, int N,
+              ThreadPool *pool);
+
+// Route B.cols() == 1 to gemvRows and A.rows() == 1 to gevmRows, returns
+// false (and leaves C alone) for any other shape
+bool multiplyVectorShapes(const DenseMatrix &A, const DenseMatrix &B,
+                          DenseMatrix &C, ThreadPool *pool);
+
+#endif // MATRIX_KERNELS_H
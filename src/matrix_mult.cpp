@@ -1,17 +1,314 @@
+#include "matrix_multiplication.h"
+#include "matrix_kernels.h"
+#include "thread_pool.h"
+#include "matrix_instrumentation.h"
+#include "matrix_tuning.h"
 #include <vector>
 #include <algorithm>
 #include <iostream>
 
+void multiplyMatricesWithoutErrors(const DenseMatrix &A, const DenseMatrix &B,
+                                   DenseMatrix &C) {
+  const int rowsA = A.rows();
+  const int colsA = A.cols();
+  const int colsB = B.cols();
+  MATRIX_INSTRUMENT("reference", rowsA, colsA, colsB, 1);
+
+  if (C.rows() != rowsA || C.cols() != colsB) {
+    C.resize(rowsA, colsB);
+  }
+
+  const int *b = B.data();
+  const int ldb = B.stride();
+
+  for (int i = 0; i < rowsA; ++i) {
+    const int *a = A.row(i);
+    int *c = C.row(i);
+
+    for (int j = 0; j < colsB; ++j) {
+      int sum = 0;
+      for (int k = 0; k < colsA; ++k) {
+        sum += a[k] * b[k * ldb + j];
+      }
+      c[j] = sum;
+    }
+  }
+}
+
+namespace {
+
+using Rows = std::vector<std::vector<int>>;
+
+// Entries of A sampled by the content probe: up to PROBE_ROWS evenly spaced
+// rows, PROBE_COLS evenly spaced entries in each
+constexpr int PROBE_ROWS = 32;
+constexpr int PROBE_COLS = 32;
+
+// With at least this fraction of zeros in A, skipping them in the i-k-j loop
+// beats the packed kernel (measured from 16^3 to 512^3, copies included).
+// On dense operands the packed kernel wins above the small-size cutoff
+constexpr double SPARSE_MIN_ZEROS = 0.75;
+
+// Small-size cutoff, in multiply-adds (rowsA * colsA * colsB): below it the
+// in place i-k-j loop beats copying to the packed kernel, and the product
+// does not touch the tuning cache nor the thread pool. Measured on one core
+// (2^3 to 128^3 and skinny shapes): 1.4x to 4x faster up to about 110k
+// multiply-adds when the rows of C are at least 32 wide, even at 64^3, then
+// slower. Narrower rows keep the i-k-j inner loop too short, it only wins up
+// to about 2k multiply-adds
+constexpr long long SMALL_MAX_OPS = 1 << 17;
+constexpr long long SMALL_NARROW_MAX_OPS = 1 << 11;
+constexpr int SMALL_WIDE_COLS = 32;
+
+// Tiles of the in place i-k-j path
+constexpr int IKJ_MC = 64;
+constexpr int IKJ_KC = 256;
+constexpr int IKJ_NC = 1024;
+
+thread_local MultiplyDispatch lastDispatch = {MultiplyPath::Empty, -1.0};
+
+double zeroFraction(const Rows &A, int rowsA, int colsA) {
+  const int rows = std::min(rowsA, PROBE_ROWS);
+  const int cols = std::min(colsA, PROBE_COLS);
+
+  int zeros = 0;
+  for (int r = 0; r < rows; ++r) {
+    const int *a = A[static_cast<long long>(r) * rowsA / rows].data();
+    for (int k = 0; k < cols; ++k) {
+      zeros += a[static_cast<long long>(k) * colsA / cols] == 0;
+    }
+  }
+  return static_cast<double>(zeros) / (rows * cols);
+}
+
+MultiplyDispatch decide(const Rows &A, const Rows &B, const Rows *C,
+                        int rowsA, int colsA, int colsB, bool autotune,
+                        TuningConfig &config) {
+  if (rowsA <= 0 || colsA <= 0 || colsB <= 0) {
+    return {MultiplyPath::Empty, -1.0};
+  }
+  if (rowsA == 1 && colsA == 1 && colsB == 1) {
+    return {MultiplyPath::Scalar, -1.0};
+  }
+  if (colsB == 1) {
+    return {MultiplyPath::MatrixVector, -1.0};
+  }
+  if (rowsA == 1) {
+    return {MultiplyPath::VectorMatrix, -1.0};
+  }
+  if (colsA == 1) {
+    return {MultiplyPath::OuterProduct, -1.0};
+  }
+
+  // The in place paths write C while A and B are still being read
+  const bool aliased = C && (C == &A || C == &B);
+
+  const long long ops = static_cast<long long>(rowsA) * colsA * colsB;
+  const long long smallOps =
+      colsB >= SMALL_WIDE_COLS ? SMALL_MAX_OPS : SMALL_NARROW_MAX_OPS;
+  if (!aliased && ops <= smallOps) {
+    return {MultiplyPath::SmallIKJ, -1.0};
+  }
+
+  const double zeros = zeroFraction(A, rowsA, colsA);
+
+  if (!aliased && zeros >= SPARSE_MIN_ZEROS) {
+    return {MultiplyPath::SparseIKJ, zeros};
+  }
+
+  const bool tuned = autotune ? tuned_config_for(rowsA, colsA, colsB, config)
+                              : find_tuned_config(rowsA, colsA, colsB, config);
+  if (tuned) {
+    return {MultiplyPath::Tuned, zeros};
+  }
+
+  return {MultiplyPath::Packed, zeros};
+}
+
+void rowsIKJ(const Rows &A, const Rows &B, Rows &C, int rowsA, int colsA,
+             int colsB, int unroll, bool skipZeros) {
+  std::vector<const int *> a(rowsA), b(colsA);
+  std::vector<int *> c(rowsA);
+  for (int i = 0; i < rowsA; ++i) {
+    a[i] = A[i].data();
+    c[i] = C[i].data();
+  }
+  for (int k = 0; k < colsA; ++k) {
+    b[k] = B[k].data();
+  }
+
+  gemmRowsIKJ(a.data(), b.data(), c.data(), rowsA, colsB, colsA, IKJ_MC,
+              IKJ_KC, IKJ_NC, unroll, skipZeros);
+}
+
+} // namespace
+
+const char *multiply_path_name(MultiplyPath path) {
+  switch (path) {
+  case MultiplyPath::Empty:
+    return "empty";
+  case MultiplyPath::Scalar:
+    return "scalar";
+  case MultiplyPath::MatrixVector:
+    return "matrix-vector";
+  case MultiplyPath::VectorMatrix:
+    return "vector-matrix";
+  case MultiplyPath::OuterProduct:
+    return "outer-product";
+  case MultiplyPath::SmallIKJ:
+    return "small-ikj";
+  case MultiplyPath::Tuned:
+    return "tuned";
+  case MultiplyPath::SparseIKJ:
+    return "sparse-ikj";
+  case MultiplyPath::Packed:
+  default:
+    return "packed";
+  }
+}
+
+MultiplyDispatch choose_multiply_path(const std::vector<std::vector<int>> &A,
+                                      const std::vector<std::vector<int>> &B,
+                                      int rowsA, int colsA, int colsB) {
+  TuningConfig config;
+  return decide(A, B, nullptr, rowsA, colsA, colsB, false, config);
+}
+
+MultiplyDispatch last_multiply_dispatch() { return lastDispatch; }
+
+// The vector of vectors signature dispatches on the shape of the product and
+// on a sample of A, see MultiplyPath. Only the packed and tuned paths copy the
+// operands into contiguous storage, the other ones work on the rows in place
 void multiplyMatricesWithoutErrors(const std::vector<std::vector<int>> &A,
                       const std::vector<std::vector<int>> &B,
                       std::vector<std::vector<int>> &C, int rowsA, int colsA,
                       int colsB) {
-  for (int i = 0; i < rowsA; ++i) {
-    for (int j = 0; j < colsB; ++j) {
-      C[i][j] = 0;
-      for (int k = 0; k < colsA; ++k) {
-        C[i][j] += A[i][k] * B[k][j];
+  MATRIX_INSTRUMENT("vectors", rowsA, colsA, colsB, 1);
+
+  TuningConfig config;
+  const MultiplyDispatch dispatch =
+      decide(A, B, &C, rowsA, colsA, colsB, true, config);
+  lastDispatch = dispatch;
+
+  switch (dispatch.path) {
+  case MultiplyPath::Empty:
+    // An empty inner dimension gives a zero product
+    if (colsA <= 0) {
+      for (int i = 0; i < rowsA; ++i) {
+        std::fill(C[i].begin(), C[i].begin() + std::max(colsB, 0), 0);
       }
     }
+    return;
+
+  case MultiplyPath::Scalar:
+    C[0][0] = static_cast<int>(static_cast<unsigned>(A[0][0]) *
+                               static_cast<unsigned>(B[0][0]));
+    return;
+
+  case MultiplyPath::MatrixVector: {
+    MATRIX_INSTRUMENT("gemv", rowsA, colsA, colsB,
+                      default_thread_pool().size());
+    pooled_vector<int> x(colsA), y(rowsA);
+    for (int k = 0; k < colsA; ++k) {
+      x[k] = B[k][0];
+    }
+
+    gemvRows([&](int i) { return A[i].data(); }, x.data(), y.data(), rowsA,
+             colsA, &default_thread_pool());
+
+    for (int i = 0; i < rowsA; ++i) {
+      C[i][0] = y[i];
+    }
+    return;
+  }
+
+  case MultiplyPath::VectorMatrix: {
+    MATRIX_INSTRUMENT("gevm", rowsA, colsA, colsB,
+                      default_thread_pool().size());
+    // gevmRows zeroes y before reading the operands: through a temporary when
+    // C is one of them
+    pooled_vector<int> temporary;
+    int *y = C[0].data();
+    if (&C == &A || &C == &B) {
+      temporary.resize(colsB);
+      y = temporary.data();
+    }
+
+    gevmRows(A[0].data(), [&](int k) { return B[k].data(); }, y, colsA, colsB,
+             &default_thread_pool());
+
+    if (y != C[0].data()) {
+      std::copy(temporary.begin(), temporary.end(), C[0].begin());
+    }
+    return;
+  }
+
+  case MultiplyPath::OuterProduct: {
+    MATRIX_INSTRUMENT("outer-product", rowsA, colsA, colsB, 1);
+    // A column times a row: every row of C is a scaled copy of B[0]. The
+    // column of A is read first in case C is one of the operands
+    std::vector<unsigned> x(rowsA);
+    for (int i = 0; i < rowsA; ++i) {
+      x[i] = A[i][0];
+    }
+    const std::vector<int> b = B[0];
+
+    for (int i = 0; i < rowsA; ++i) {
+      int *c = C[i].data();
+      for (int j = 0; j < colsB; ++j) {
+        c[j] = static_cast<int>(x[i] * static_cast<unsigned>(b[j]));
+      }
+    }
+    return;
+  }
+
+  case MultiplyPath::SmallIKJ: {
+    MATRIX_INSTRUMENT("small-ikj", rowsA, colsA, colsB, 1);
+    rowsIKJ(A, B, C, rowsA, colsA, colsB, 4, false);
+    return;
+  }
+
+  case MultiplyPath::SparseIKJ: {
+    MATRIX_INSTRUMENT("sparse-ikj", rowsA, colsA, colsB, 1);
+    // One row at a time keeps the zero test per entry of A
+    rowsIKJ(A, B, C, rowsA, colsA, colsB, 1, true);
+    return;
+  }
+
+  case MultiplyPath::Tuned:
+  case MultiplyPath::Packed:
+  default:
+    break;
+  }
+
+  const DenseMatrix denseA(A, rowsA, colsA);
+  const DenseMatrix denseB(B, colsA, colsB);
+  DenseMatrix denseC(rowsA, colsB);
+
+  if (dispatch.path == MultiplyPath::Tuned) {
+    multiplyMatricesTuned(denseA, denseB, denseC, config);
+  } else {
+    multiplyMatricesParallel(denseA, denseB, denseC);
+  }
+
+  denseC.copy_to(C);
+}
+
+void multiplyMatricesWithoutErrors(const DenseMatrix &A, const DenseMatrix &B,
+                                   DenseMatrix &C, MultiplyKernel kernel) {
+  switch (kernel) {
+  case MultiplyKernel::Blocked:
+    multiplyMatricesBlocked(A, B, C);
+    break;
+  case MultiplyKernel::Parallel:
+    multiplyMatricesParallel(A, B, C);
+    break;
+  case MultiplyKernel::Strassen:
+    multiplyMatricesStrassen(A, B, C);
+    break;
+  case MultiplyKernel::Reference:
+  default:
+    multiplyMatricesWithoutErrors(A, B, C);
+    break;
   }
-}
\ No newline at end of file
+}
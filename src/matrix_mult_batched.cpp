@@ -0,0 +1,208 @@
+#include "batched_multiplication.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <stdexcept>
+
+// Two strategies for the batch, see batched_multiplication.h:
+//
+//  * interleaved: LANES matrices are transposed into a [element][lane] layout,
+//    so the innermost loop runs over the lanes, i.e. over different matrices.
+//    A 2x2 product has no vector parallelism of its own, the batch does.
+//
+//  * one at a time: i-k-j loop on each matrix, the j loop is unit stride and
+//    long enough (up to 32) to vectorise by itself.
+//
+// The kernels are cloned for AVX-512/AVX2 and picked at load time (ifunc),
+// so the lane loops use the widest registers of the machine.
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define BATCH_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define BATCH_CLONES
+#endif
+
+namespace {
+
+constexpr int LANES = 16;
+
+// Matrices handed to one task of the pool
+constexpr int BATCH_CHUNK = 256;
+
+// c[(i*N + j)*LANES + l] = sum_k a[(i*K + k)*LANES + l] * b[(k*N + j)*LANES + l]
+BATCH_CLONES void interleavedKernel(int M, int N, int K, const int *a,
+                                    const int *b, int *c) {
+  for (int i = 0; i < M; ++i) {
+    for (int j = 0; j < N; ++j) {
+      // Unsigned: the int32 wrap around without undefined behaviour
+      unsigned acc[LANES] = {};
+      for (int k = 0; k < K; ++k) {
+        const int *ap = a + (i * K + k) * LANES;
+        const int *bp = b + (k * N + j) * LANES;
+        for (int l = 0; l < LANES; ++l) {
+          acc[l] += static_cast<unsigned>(ap[l]) * static_cast<unsigned>(bp[l]);
+        }
+      }
+      int *cp = c + (i * N + j) * LANES;
+      for (int l = 0; l < LANES; ++l) {
+        cp[l] = static_cast<int>(acc[l]);
+      }
+    }
+  }
+}
+
+BATCH_CLONES void singleKernel(int M, int N, int K, const int *A,
+                               std::ptrdiff_t lda, const int *B,
+                               std::ptrdiff_t ldb, int *C, std::ptrdiff_t ldc) {
+  for (int i = 0; i < M; ++i) {
+    int *c = C + i * ldc;
+    std::fill(c, c + N, 0);
+    for (int k = 0; k < K; ++k) {
+      const unsigned aik = A[i * lda + k];
+      const int *b = B + k * ldb;
+      for (int j = 0; j < N; ++j) {
+        c[j] = static_cast<int>(static_cast<unsigned>(c[j]) +
+                                aik * static_cast<unsigned>(b[j]));
+      }
+    }
+  }
+}
+
+// getA(b), getB(b), getC(b) return the first element of matrix b
+template <typename GetA, typename GetB, typename GetC>
+void batched(int batch, int M, int N, int K, GetA getA, std::ptrdiff_t lda,
+             GetB getB, std::ptrdiff_t ldb, GetC getC, std::ptrdiff_t ldc) {
+  if (batch <= 0 || M <= 0 || N <= 0) {
+    return;
+  }
+
+  const bool interleave = M <= BATCH_INTERLEAVE_MAX &&
+                          N <= BATCH_INTERLEAVE_MAX &&
+                          K <= BATCH_INTERLEAVE_MAX;
+
+  const int chunks = (batch + BATCH_CHUNK - 1) / BATCH_CHUNK;
+
+  default_thread_pool().parallel_for(chunks, [&](int chunk) {
+    const int first = chunk * BATCH_CHUNK;
+    const int last = std::min(batch, first + BATCH_CHUNK);
+
+    if (!interleave) {
+      for (int b = first; b < last; ++b) {
+        singleKernel(M, N, K, getA(b), lda, getB(b), ldb, getC(b), ldc);
+      }
+      return;
+    }
+
+    thread_local std::vector<int> a, bb, c;
+    a.resize(static_cast<size_t>(M) * K * LANES);
+    bb.resize(static_cast<size_t>(K) * N * LANES);
+    c.resize(static_cast<size_t>(M) * N * LANES);
+
+    for (int b0 = first; b0 < last; b0 += LANES) {
+      const int lanes = std::min(LANES, last - b0);
+
+      // Unused lanes multiply zeros
+      if (lanes < LANES) {
+        std::fill(a.begin(), a.end(), 0);
+        std::fill(bb.begin(), bb.end(), 0);
+      }
+
+      const int *As[LANES];
+      const int *Bs[LANES];
+      for (int l = 0; l < lanes; ++l) {
+        As[l] = getA(b0 + l);
+        Bs[l] = getB(b0 + l);
+      }
+
+      // Lane loop innermost: the writes into the packed buffers are contiguous
+      for (int i = 0; i < M; ++i) {
+        for (int k = 0; k < K; ++k) {
+          int *dst = a.data() + (i * K + k) * LANES;
+          for (int l = 0; l < lanes; ++l) {
+            dst[l] = As[l][i * lda + k];
+          }
+        }
+      }
+      for (int k = 0; k < K; ++k) {
+        for (int j = 0; j < N; ++j) {
+          int *dst = bb.data() + (k * N + j) * LANES;
+          for (int l = 0; l < lanes; ++l) {
+            dst[l] = Bs[l][k * ldb + j];
+          }
+        }
+      }
+
+      interleavedKernel(M, N, K, a.data(), bb.data(), c.data());
+
+      int *Cs[LANES];
+      for (int l = 0; l < lanes; ++l) {
+        Cs[l] = getC(b0 + l);
+      }
+
+      for (int i = 0; i < M; ++i) {
+        for (int j = 0; j < N; ++j) {
+          const int *src = c.data() + (i * N + j) * LANES;
+          for (int l = 0; l < lanes; ++l) {
+            Cs[l][i * ldc + j] = src[l];
+          }
+        }
+      }
+    }
+  });
+}
+
+} // namespace
+
+void multiplyMatricesBatched(int batch, int M, int N, int K, const int *A,
+                             std::ptrdiff_t lda, std::ptrdiff_t strideA,
+                             const int *B, std::ptrdiff_t ldb,
+                             std::ptrdiff_t strideB, int *C,
+                             std::ptrdiff_t ldc, std::ptrdiff_t strideC) {
+  batched(
+      batch, M, N, K, [&](int b) { return A + b * strideA; }, lda,
+      [&](int b) { return B + b * strideB; }, ldb,
+      [&](int b) { return C + b * strideC; }, ldc);
+}
+
+void multiplyMatricesBatched(int batch, int M, int N, int K,
+                             const int *const *A, std::ptrdiff_t lda,
+                             const int *const *B, std::ptrdiff_t ldb,
+                             int *const *C, std::ptrdiff_t ldc) {
+  batched(
+      batch, M, N, K, [&](int b) { return A[b]; }, lda,
+      [&](int b) { return B[b]; }, ldb, [&](int b) { return C[b]; }, ldc);
+}
+
+void multiplyMatricesBatched(const std::vector<DenseMatrix> &A,
+                             const std::vector<DenseMatrix> &B,
+                             std::vector<DenseMatrix> &C) {
+  if (B.size() != A.size()) {
+    throw std::invalid_argument(
+        "multiplyMatricesBatched: A and B must hold as many matrices");
+  }
+  if (!A.empty() && B[0].rows() != A[0].cols()) {
+    throw std::invalid_argument(
+        "multiplyMatricesBatched: B[0].rows() must be A[0].cols()");
+  }
+
+  const int batch = static_cast<int>(A.size());
+
+  C.resize(A.size());
+  if (batch == 0) {
+    return;
+  }
+
+  const int M = A[0].rows();
+  const int K = A[0].cols();
+  const int N = B[0].cols();
+
+  for (auto &c : C) {
+    if (c.rows() != M || c.cols() != N || c.stride() != N) {
+      c.resize(M, N);
+    }
+  }
+
+  batched(
+      batch, M, N, K, [&](int b) { return A[b].data(); }, A[0].stride(),
+      [&](int b) { return B[b].data(); }, B[0].stride(),
+      [&](int b) { return C[b].data(); }, N);
+}
@@ -0,0 +1,182 @@
+#include "matrix_multiplication.h"
+#include "matrix_kernels.h"
+#include "matrix_instrumentation.h"
+#include <vector>
+#include <algorithm>
+
+// Cache-blocked multiplication in the usual GotoBLAS structure:
+//
+//   for jc in N step NC        <- B panel KC x NC lives in L3
+//     for pc in K step KC      <- pack B[pc:pc+KC, jc:jc+NC] in NR wide slivers
+//       for ic in M step MC    <- pack A[ic:ic+MC, pc:pc+KC] in MR tall slivers (L2)
+//         for jr, ir           <- MR x NR micro-kernel on one sliver of each
+//
+// Packing makes every access of the micro-kernel unit stride, and the zero
+// padding of the slivers lets it always work on a full MR x NR tile. Since
+// the operands are only read while packing, any pair of strides works: a
+// transposed operand is just a different (row, column) stride pair.
+
+namespace {
+
+// C[0:m, 0:n] *= beta
+void scaleTile(int *C, std::ptrdiff_t ldc, int m, int n, int beta) {
+  for (int i = 0; i < m; ++i) {
+    int *c = C + i * ldc;
+    for (int j = 0; j < n; ++j) {
+      c[j] = beta == 0 ? 0 : wrapMul(beta, c[j]);
+    }
+  }
+}
+
+// Pack alpha * A[0:mc, 0:kc] into ceil(mc/MR) slivers, each stored k-major:
+// a[p*MR + i]. Element (i, p) of A is A[i*rsa + p*csa]
+void packA(const int *A, std::ptrdiff_t rsa, std::ptrdiff_t csa, int mc, int kc,
+           int alpha, int *packed) {
+  for (int ir = 0; ir < mc; ir += GEMM_MR) {
+    const int mr = std::min(GEMM_MR, mc - ir);
+    for (int p = 0; p < kc; ++p) {
+      const int *a = A + ir * rsa + p * csa;
+      for (int i = 0; i < mr; ++i) {
+        packed[i] = alpha == 1 ? a[i * rsa] : wrapMul(alpha, a[i * rsa]);
+      }
+      for (int i = mr; i < GEMM_MR; ++i) {
+        packed[i] = 0;
+      }
+      packed += GEMM_MR;
+    }
+  }
+}
+
+// Pack B[0:kc, 0:nc] into ceil(nc/NR) slivers, each stored k-major:
+// b[p*NR + j]. Element (p, j) of B is B[p*rsb + j*csb]
+void packB(const int *B, std::ptrdiff_t rsb, std::ptrdiff_t csb, int kc, int nc,
+           int *packed) {
+  for (int jr = 0; jr < nc; jr += GEMM_NR) {
+    const int nr = std::min(GEMM_NR, nc - jr);
+    for (int p = 0; p < kc; ++p) {
+      const int *b = B + p * rsb + jr * csb;
+      if (csb == 1) {
+        std::copy(b, b + nr, packed);
+      } else {
+        for (int j = 0; j < nr; ++j) {
+          packed[j] = b[j * csb];
+        }
+      }
+      std::fill(packed + nr, packed + GEMM_NR, 0);
+      packed += GEMM_NR;
+    }
+  }
+}
+
+} // namespace
+
+void gemmStrided(const int *A, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+                 const int *B, std::ptrdiff_t rsb, std::ptrdiff_t csb, int *C,
+                 std::ptrdiff_t ldc, int M, int N, int K, int alpha, int beta) {
+  gemmStrided(A, rsa, csa, B, rsb, csb, C, ldc, M, N, K, alpha, beta,
+              GemmBlocking());
+}
+
+void gemmStrided(const int *A, std::ptrdiff_t rsa, std::ptrdiff_t csa,
+                 const int *B, std::ptrdiff_t rsb, std::ptrdiff_t csb, int *C,
+                 std::ptrdiff_t ldc, int M, int N, int K, int alpha, int beta,
+                 const GemmBlocking &blocking) {
+  if (M <= 0 || N <= 0) {
+    return;
+  }
+
+  if (K <= 0 || alpha == 0) {
+    scaleTile(C, ldc, M, N, beta);
+    return;
+  }
+
+  // Packing buffers are reused across calls made by the same thread
+  thread_local std::vector<int> packedA;
+  thread_local std::vector<int> packedB;
+  const int MC = blocking.mc;
+  const int KC = blocking.kc;
+  const int NC = blocking.nc;
+  packedA.resize(static_cast<std::size_t>(MC) * KC);
+  packedB.resize(static_cast<std::size_t>(KC) * NC);
+
+  // Widest SIMD micro-kernel the CPU supports, see matrix_simd_kernels.cpp
+  const MicroKernel microKernel = activeMicroKernel();
+
+  // Edge tiles are computed into a scratch tile and copied out. The rows and
+  // columns past the edge are never copied in, they must still be defined
+  int edge[GEMM_MR * GEMM_NR] = {};
+
+  for (int jc = 0; jc < N; jc += NC) {
+    const int nc = std::min(NC, N - jc);
+
+    for (int pc = 0; pc < K; pc += KC) {
+      const int kc = std::min(KC, K - pc);
+      // On the first panel C is either overwritten (beta == 0) or scaled in
+      // place, tile by tile, while the tile is being brought in anyway
+      const bool first = pc == 0;
+      const bool accumulate = !first || beta != 0;
+      const bool scale = first && beta != 0 && beta != 1;
+
+      packB(B + pc * rsb + jc * csb, rsb, csb, kc, nc, packedB.data());
+
+      for (int ic = 0; ic < M; ic += MC) {
+        const int mc = std::min(MC, M - ic);
+
+        packA(A + ic * rsa + pc * csa, rsa, csa, mc, kc, alpha,
+              packedA.data());
+
+        for (int jr = 0; jr < nc; jr += GEMM_NR) {
+          const int nr = std::min(GEMM_NR, nc - jr);
+          const int *b = packedB.data() + jr * kc;
+
+          for (int ir = 0; ir < mc; ir += GEMM_MR) {
+            const int mr = std::min(GEMM_MR, mc - ir);
+            const int *a = packedA.data() + ir * kc;
+            int *c = C + (ic + ir) * ldc + jc + jr;
+
+            if (scale) {
+              scaleTile(c, ldc, mr, nr, beta);
+            }
+
+            if (mr == GEMM_MR && nr == GEMM_NR) {
+              microKernel(kc, a, b, c, ldc, accumulate);
+              continue;
+            }
+
+            if (accumulate) {
+              for (int i = 0; i < mr; ++i) {
+                std::copy(c + i * ldc, c + i * ldc + nr, edge + i * GEMM_NR);
+              }
+            }
+            microKernel(kc, a, b, edge, GEMM_NR, accumulate);
+            for (int i = 0; i < mr; ++i) {
+              std::copy(edge + i * GEMM_NR, edge + i * GEMM_NR + nr, c + i * ldc);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void gemmBlocked(const int *A, std::ptrdiff_t lda, const int *B,
+                 std::ptrdiff_t ldb, int *C, std::ptrdiff_t ldc, int M, int N,
+                 int K, int alpha, int beta) {
+  gemmStrided(A, lda, 1, B, ldb, 1, C, ldc, M, N, K, alpha, beta);
+}
+
+void multiplyMatricesBlocked(const DenseMatrix &A, const DenseMatrix &B,
+                             DenseMatrix &C) {
+  MATRIX_INSTRUMENT("blocked", A.rows(), A.cols(), B.cols(), 1);
+
+  if (multiplyVectorShapes(A, B, C, nullptr)) {
+    return;
+  }
+
+  if (C.rows() != A.rows() || C.cols() != B.cols()) {
+    C.resize(A.rows(), B.cols());
+  }
+
+  gemmBlocked(A.data(), A.stride(), B.data(), B.stride(), C.data(), C.stride(),
+              A.rows(), B.cols(), A.cols());
+}
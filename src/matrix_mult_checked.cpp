@@ -0,0 +1,164 @@
+#include "matrix_multiplication.h"
+#include "thread_pool.h"
+#include "matrix_instrumentation.h"
+#include <vector>
+#include <algorithm>
+#include <climits>
+
+// Widened multiplication: products and sums are carried in int64, so nothing
+// overflows while accumulating (as long as colsA * max|a| * max|b| < 2^63).
+//
+// Narrowing back to int is checked once per tile of C: while a tile is stored
+// its min and max are reduced, and only a tile whose range does not fit in
+// int is revisited element by element. For the common case of no overflow the
+// check is two vectorised reductions per tile.
+
+namespace {
+
+constexpr int TILE_M = 32;
+constexpr int TILE_N = 256;
+constexpr int TILE_K = 128;
+
+// acc[0:m, 0:n] = A[i0:i0+m, :] * B[:, j0:j0+n] in int64, acc has stride TILE_N
+void accumulateTile(const DenseMatrix &A, const DenseMatrix &B, int i0, int j0,
+                    int m, int n, long long *acc) {
+  std::fill(acc, acc + TILE_M * TILE_N, 0LL);
+
+  const int K = A.cols();
+
+  for (int k0 = 0; k0 < K; k0 += TILE_K) {
+    const int kb = std::min(TILE_K, K - k0);
+
+    for (int i = 0; i < m; ++i) {
+      const int *a = A.row(i0 + i) + k0;
+      long long *c = acc + i * TILE_N;
+
+      for (int p = 0; p < kb; ++p) {
+        const long long ap = a[p];
+        const int *b = B.row(k0 + p) + j0;
+        for (int j = 0; j < n; ++j) {
+          c[j] += ap * b[j];
+        }
+      }
+    }
+  }
+}
+
+// Run body(tile, i0, j0, m, n, acc) on every tile of the M x N output, in
+// parallel: tile is the index of the tile (row major), acc its int64 sums
+template <typename Body>
+void forEachTile(const DenseMatrix &A, const DenseMatrix &B, Body body) {
+  const int M = A.rows();
+  const int N = B.cols();
+  const int tilesM = (M + TILE_M - 1) / TILE_M;
+  const int tilesN = (N + TILE_N - 1) / TILE_N;
+
+  default_thread_pool().parallel_for(tilesM * tilesN, [&](int tile) {
+    thread_local std::vector<long long> acc(TILE_M * TILE_N);
+
+    const int i0 = (tile / tilesN) * TILE_M;
+    const int j0 = (tile % tilesN) * TILE_N;
+    const int m = std::min(TILE_M, M - i0);
+    const int n = std::min(TILE_N, N - j0);
+
+    accumulateTile(A, B, i0, j0, m, n, acc.data());
+    body(tile, i0, j0, m, n, acc.data());
+  });
+}
+
+} // namespace
+
+bool multiplyMatricesChecked(const DenseMatrix &A, const DenseMatrix &B,
+                             DenseMatrix &C, OverflowPolicy policy,
+                             std::vector<OverflowTile> *overflows) {
+  MATRIX_INSTRUMENT("checked", A.rows(), A.cols(), B.cols(),
+                    default_thread_pool().size());
+
+  if (C.rows() != A.rows() || C.cols() != B.cols()) {
+    C.resize(A.rows(), B.cols());
+  }
+
+  const int tilesN = (B.cols() + TILE_N - 1) / TILE_N;
+  const int tilesM = (A.rows() + TILE_M - 1) / TILE_M;
+
+  // One flag per tile, written by the thread owning the tile only
+  std::vector<char> overflowed(static_cast<size_t>(tilesM) * tilesN, 0);
+
+  forEachTile(A, B, [&](int tile, int i0, int j0, int m, int n,
+                        const long long *acc) {
+    long long lo = 0, hi = 0;
+
+    for (int i = 0; i < m; ++i) {
+      const long long *s = acc + i * TILE_N;
+      int *c = C.row(i0 + i) + j0;
+      for (int j = 0; j < n; ++j) {
+        lo = std::min(lo, s[j]);
+        hi = std::max(hi, s[j]);
+        c[j] = static_cast<int>(s[j]);
+      }
+    }
+
+    if (lo >= INT_MIN && hi <= INT_MAX) {
+      return;
+    }
+
+    overflowed[tile] = 1;
+
+    if (policy == OverflowPolicy::Saturate) {
+      for (int i = 0; i < m; ++i) {
+        const long long *s = acc + i * TILE_N;
+        int *c = C.row(i0 + i) + j0;
+        for (int j = 0; j < n; ++j) {
+          c[j] = static_cast<int>(std::clamp<long long>(s[j], INT_MIN, INT_MAX));
+        }
+      }
+    }
+  });
+
+  bool clean = true;
+
+  for (int tile = 0; tile < tilesM * tilesN; ++tile) {
+    if (!overflowed[tile]) {
+      continue;
+    }
+
+    clean = false;
+
+    if (overflows) {
+      const int i0 = (tile / tilesN) * TILE_M;
+      const int j0 = (tile % tilesN) * TILE_N;
+      overflows->push_back({i0, j0, std::min(TILE_M, A.rows() - i0),
+                            std::min(TILE_N, B.cols() - j0)});
+    }
+  }
+
+  return clean;
+}
+
+void multiplyMatricesWide(const DenseMatrix &A, const DenseMatrix &B,
+                          BasicDenseMatrix<long long> &C) {
+  MATRIX_INSTRUMENT("wide", A.rows(), A.cols(), B.cols(),
+                    default_thread_pool().size());
+
+  if (C.rows() != A.rows() || C.cols() != B.cols()) {
+    C.resize(A.rows(), B.cols());
+  }
+
+  forEachTile(A, B, [&](int, int i0, int j0, int m, int n,
+                        const long long *acc) {
+    for (int i = 0; i < m; ++i) {
+      std::copy(acc + i * TILE_N, acc + i * TILE_N + n, C.row(i0 + i) + j0);
+    }
+  });
+}
+
+bool multiplyMatricesWithoutErrors(const DenseMatrix &A, const DenseMatrix &B,
+                                   DenseMatrix &C, OverflowPolicy policy,
+                                   std::vector<OverflowTile> *overflows) {
+  return multiplyMatricesChecked(A, B, C, policy, overflows);
+}
+
+void multiplyMatricesWithoutErrors(const DenseMatrix &A, const DenseMatrix &B,
+                                   BasicDenseMatrix<long long> &C) {
+  multiplyMatricesWide(A, B, C);
+}
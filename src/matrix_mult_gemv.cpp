@@ -0,0 +1,206 @@
+#include "matrix_multiplication.h"
+#include "matrix_kernels.h"
+#include "matrix_allocator.h"
+#include "thread_pool.h"
+#include "matrix_instrumentation.h"
+#include <algorithm>
+
+// Matrix-vector (GEMV, y = A * x) and vector-matrix (GEVM, y = x * B) kernels.
+//
+// Both are bound by the bandwidth of streaming the matrix, which is read
+// exactly once, along its rows, with no packing:
+//  * GEMV: every entry of y is the dot product of a row of A with x. Rows go
+//    four at a time so that each load of x feeds four multiply-adds
+//  * GEVM: y accumulates x[k] * B[k, :], four rows of B per pass over y. The
+//    columns are cut in slices small enough for the slice of y to stay in L1
+//    while all the rows stream through
+// The arithmetic is done on unsigned values (the same int32 wrap around as
+// the other kernels) so that the reductions are free to vectorise.
+
+namespace {
+
+// Below this many elements of the matrix one thread does the whole product
+constexpr long long VECTOR_PARALLEL_MIN = 1 << 16;
+
+// Rows of A per GEMV task, columns of y per GEVM task (4 KiB of y)
+constexpr int GEMV_ROWS_PER_TASK = 64;
+constexpr int GEVM_COLS_PER_TASK = 1024;
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define VECTOR_KERNEL_CLONES                                                   \
+  __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define VECTOR_KERNEL_CLONES
+#endif
+
+VECTOR_KERNEL_CLONES
+int dot(const int *a, const int *x, int K) {
+  unsigned sum = 0;
+  for (int k = 0; k < K; ++k) {
+    sum += static_cast<unsigned>(a[k]) * static_cast<unsigned>(x[k]);
+  }
+  return static_cast<int>(sum);
+}
+
+VECTOR_KERNEL_CLONES
+void dot4(const int *a0, const int *a1, const int *a2, const int *a3,
+          const int *x, int K, int *y) {
+  unsigned s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  for (int k = 0; k < K; ++k) {
+    const unsigned xk = x[k];
+    s0 += static_cast<unsigned>(a0[k]) * xk;
+    s1 += static_cast<unsigned>(a1[k]) * xk;
+    s2 += static_cast<unsigned>(a2[k]) * xk;
+    s3 += static_cast<unsigned>(a3[k]) * xk;
+  }
+  y[0] = static_cast<int>(s0);
+  y[1] = static_cast<int>(s1);
+  y[2] = static_cast<int>(s2);
+  y[3] = static_cast<int>(s3);
+}
+
+// y[0:n] += x * b[0:n]
+VECTOR_KERNEL_CLONES
+void axpy(int x, const int *b, int *y, int n) {
+  const unsigned ux = x;
+  for (int j = 0; j < n; ++j) {
+    y[j] = static_cast<int>(static_cast<unsigned>(y[j]) +
+                            ux * static_cast<unsigned>(b[j]));
+  }
+}
+
+// y[0:n] += x0 * b0[0:n] + ... + x3 * b3[0:n]
+VECTOR_KERNEL_CLONES
+void axpy4(const int *x, const int *b0, const int *b1, const int *b2,
+           const int *b3, int *y, int n) {
+  const unsigned x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3];
+  for (int j = 0; j < n; ++j) {
+    y[j] = static_cast<int>(static_cast<unsigned>(y[j]) +
+                            x0 * static_cast<unsigned>(b0[j]) +
+                            x1 * static_cast<unsigned>(b1[j]) +
+                            x2 * static_cast<unsigned>(b2[j]) +
+                            x3 * static_cast<unsigned>(b3[j]));
+  }
+}
+
+void runTasks(ThreadPool *pool, long long elements, int tasks,
+              const std::function<void(int)> &task) {
+  if (pool && elements >= VECTOR_PARALLEL_MIN && tasks > 1) {
+    pool->parallel_for(tasks, task);
+  } else {
+    for (int t = 0; t < tasks; ++t) {
+      task(t);
+    }
+  }
+}
+
+} // namespace
+
+void gemvRows(const RowAccessor &rowA, const int *x, int *y, int M, int K,
+              ThreadPool *pool) {
+  const int tasks = (M + GEMV_ROWS_PER_TASK - 1) / GEMV_ROWS_PER_TASK;
+
+  runTasks(pool, static_cast<long long>(M) * K, tasks, [&](int t) {
+    const int i0 = t * GEMV_ROWS_PER_TASK;
+    const int i1 = std::min(M, i0 + GEMV_ROWS_PER_TASK);
+
+    int i = i0;
+    for (; i + 4 <= i1; i += 4) {
+      dot4(rowA(i), rowA(i + 1), rowA(i + 2), rowA(i + 3), x, K, y + i);
+    }
+    for (; i < i1; ++i) {
+      y[i] = dot(rowA(i), x, K);
+    }
+  });
+}
+
+void gevmRows(const int *x, const RowAccessor &rowB, int *y, int K, int N,
+              ThreadPool *pool) {
+  const int tasks = (N + GEVM_COLS_PER_TASK - 1) / GEVM_COLS_PER_TASK;
+
+  runTasks(pool, static_cast<long long>(K) * N, tasks, [&](int t) {
+    const int j0 = t * GEVM_COLS_PER_TASK;
+    const int n = std::min(N - j0, GEVM_COLS_PER_TASK);
+    int *yj = y + j0;
+
+    std::fill(yj, yj + n, 0);
+
+    int k = 0;
+    for (; k + 4 <= K; k += 4) {
+      axpy4(x + k, rowB(k) + j0, rowB(k + 1) + j0, rowB(k + 2) + j0,
+            rowB(k + 3) + j0, yj, n);
+    }
+    for (; k < K; ++k) {
+      axpy(x[k], rowB(k) + j0, yj, n);
+    }
+  });
+}
+
+bool multiplyVectorShapes(const DenseMatrix &A, const DenseMatrix &B,
+                          DenseMatrix &C, ThreadPool *pool) {
+  const int M = A.rows();
+  const int K = A.cols();
+  const int N = B.cols();
+
+  if (N != 1 && M != 1) {
+    return false;
+  }
+
+  MATRIX_INSTRUMENT(N == 1 ? "gemv" : "gevm", M, K, N, pool ? pool->size() : 1);
+
+  if (C.rows() != M || C.cols() != N) {
+    C.resize(M, N);
+  }
+
+  if (N == 1) {
+    // The column of B and the column of C are contiguous unless padded
+    pooled_vector<int> column;
+    const int *x = B.data();
+    if (B.stride() != 1) {
+      column.resize(K);
+      for (int k = 0; k < K; ++k) {
+        column[k] = B(k, 0);
+      }
+      x = column.data();
+    }
+
+    pooled_vector<int> result;
+    int *y = C.data();
+    if (C.stride() != 1) {
+      result.resize(M);
+      y = result.data();
+    }
+
+    gemvRows([&](int i) { return A.row(i); }, x, y, M, K, pool);
+
+    if (C.stride() != 1) {
+      for (int i = 0; i < M; ++i) {
+        C(i, 0) = y[i];
+      }
+    }
+  } else {
+    gevmRows(A.row(0), [&](int k) { return B.row(k); }, C.row(0), K, N, pool);
+  }
+
+  return true;
+}
+
+void multiplyMatrixVector(const DenseMatrix &A, const std::vector<int> &x,
+                          std::vector<int> &y) {
+  MATRIX_INSTRUMENT("gemv", A.rows(), A.cols(), 1,
+                    default_thread_pool().size());
+
+  y.resize(A.rows());
+  gemvRows([&](int i) { return A.row(i); }, x.data(), y.data(), A.rows(),
+           A.cols(), &default_thread_pool());
+}
+
+void multiplyVectorMatrix(const std::vector<int> &x, const DenseMatrix &B,
+                          std::vector<int> &y) {
+  MATRIX_INSTRUMENT("gevm", 1, B.rows(), B.cols(),
+                    default_thread_pool().size());
+
+  y.resize(B.cols());
+  gevmRows(x.data(), [&](int k) { return B.row(k); }, y.data(), B.rows(),
+           B.cols(), &default_thread_pool());
+}
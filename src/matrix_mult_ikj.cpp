@@ -0,0 +1,105 @@
+#include "matrix_kernels.h"
+#include <algorithm>
+
+// Tiled i-k-j multiplication over tables of row pointers, so that it runs in
+// place on any row storage (dense rows or a vector of vectors).
+//
+// Every a[i][k] scales row k of B into row i of C: the inner loop streams two
+// contiguous rows and vectorises, with no packing and no copy. `unroll` rows
+// of C are updated together so that one load of B feeds several
+// multiply-adds. Tiles over i, k and j keep the rows of B of a tile in cache
+// while they are reused by the rows of A.
+
+namespace {
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define IKJ_KERNEL_CLONES                                                      \
+  __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define IKJ_KERNEL_CLONES
+#endif
+
+// c0[0:n] += x0 * b[0:n], and the same for the other rows of C
+IKJ_KERNEL_CLONES
+void update1(int *c0, int x0, const int *b, int n) {
+  const unsigned u0 = x0;
+  for (int j = 0; j < n; ++j) {
+    c0[j] = static_cast<int>(static_cast<unsigned>(c0[j]) +
+                             u0 * static_cast<unsigned>(b[j]));
+  }
+}
+
+IKJ_KERNEL_CLONES
+void update2(int *c0, int *c1, int x0, int x1, const int *b, int n) {
+  const unsigned u0 = x0, u1 = x1;
+  for (int j = 0; j < n; ++j) {
+    const unsigned bj = b[j];
+    c0[j] = static_cast<int>(static_cast<unsigned>(c0[j]) + u0 * bj);
+    c1[j] = static_cast<int>(static_cast<unsigned>(c1[j]) + u1 * bj);
+  }
+}
+
+IKJ_KERNEL_CLONES
+void update4(int *c0, int *c1, int *c2, int *c3, const int *x, const int *b,
+             int n) {
+  const unsigned u0 = x[0], u1 = x[1], u2 = x[2], u3 = x[3];
+  for (int j = 0; j < n; ++j) {
+    const unsigned bj = b[j];
+    c0[j] = static_cast<int>(static_cast<unsigned>(c0[j]) + u0 * bj);
+    c1[j] = static_cast<int>(static_cast<unsigned>(c1[j]) + u1 * bj);
+    c2[j] = static_cast<int>(static_cast<unsigned>(c2[j]) + u2 * bj);
+    c3[j] = static_cast<int>(static_cast<unsigned>(c3[j]) + u3 * bj);
+  }
+}
+
+} // namespace
+
+void gemmRowsIKJ(const int *const *a, const int *const *b, int *const *c,
+                 int M, int N, int K, int MC, int KC, int NC, int unroll,
+                 bool skipZeros) {
+  for (int i = 0; i < M; ++i) {
+    std::fill(c[i], c[i] + N, 0);
+  }
+
+  for (int ic = 0; ic < M; ic += MC) {
+    const int i1 = std::min(M, ic + MC);
+
+    for (int pc = 0; pc < K; pc += KC) {
+      const int p1 = std::min(K, pc + KC);
+
+      for (int jc = 0; jc < N; jc += NC) {
+        const int nc = std::min(NC, N - jc);
+
+        int i = ic;
+        for (; unroll == 4 && i + 4 <= i1; i += 4) {
+          for (int p = pc; p < p1; ++p) {
+            const int x[4] = {a[i][p], a[i + 1][p], a[i + 2][p], a[i + 3][p]};
+            if (skipZeros && (x[0] | x[1] | x[2] | x[3]) == 0) {
+              continue;
+            }
+            update4(c[i] + jc, c[i + 1] + jc, c[i + 2] + jc, c[i + 3] + jc, x,
+                    b[p] + jc, nc);
+          }
+        }
+        for (; unroll >= 2 && i + 2 <= i1; i += 2) {
+          for (int p = pc; p < p1; ++p) {
+            const int x0 = a[i][p], x1 = a[i + 1][p];
+            if (skipZeros && (x0 | x1) == 0) {
+              continue;
+            }
+            update2(c[i] + jc, c[i + 1] + jc, x0, x1, b[p] + jc, nc);
+          }
+        }
+        for (; i < i1; ++i) {
+          for (int p = pc; p < p1; ++p) {
+            const int x0 = a[i][p];
+            if (skipZeros && x0 == 0) {
+              continue;
+            }
+            update1(c[i] + jc, x0, b[p] + jc, nc);
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,152 @@
+#include "matrix_multiplication.h"
+#include "matrix_kernels.h"
+#include "thread_pool.h"
+#include "matrix_instrumentation.h"
+#include <algorithm>
+#include <stdexcept>
+
+// Parallel multiplication: C is cut in a 2D grid of tiles and every tile is an
+// independent call of the blocked kernel over the full K dimension. Since each
+// element of C is still summed in the same k order the result is identical to
+// the serial kernel.
+
+namespace {
+
+// Shrink the tiles until there are a few of them per thread, so that work
+// stealing has something to balance, but keep them a multiple of the
+// micro-kernel block
+void chooseTiles(int M, int N, int threads, int &tileM, int &tileN) {
+  tileM = GEMM_MC;
+  tileN = 2 * GEMM_MC;
+
+  const long long wanted = 4LL * threads;
+
+  while (static_cast<long long>((M + tileM - 1) / tileM) *
+             ((N + tileN - 1) / tileN) <
+         wanted) {
+    if (tileN >= tileM && tileN > 2 * GEMM_NR) {
+      tileN /= 2;
+    } else if (tileM > 2 * GEMM_MR) {
+      tileM /= 2;
+    } else {
+      break;
+    }
+  }
+}
+
+// Below this depth the 16 horizontal sums per 4x4 block of the row-dot kernel
+// cost more than packing B^T does
+constexpr int ROW_DOT_MIN_K = 512;
+
+// C = alpha * A * B + beta * C, C already has the right shape. The operands
+// may have any strides: A * B^T (B^T row-major) with a deep K goes to the
+// row-dot kernel, every other case to the packing of the blocked kernel
+void gemmParallel(const MatrixView<int> &A, const MatrixView<int> &B,
+                  DenseMatrix &C, int alpha, int beta, ThreadPool &pool) {
+  const int M = A.rows();
+  const int N = B.cols();
+  const int K = A.cols();
+
+  if (M == 0 || N == 0) {
+    return;
+  }
+
+  int tileM, tileN;
+  chooseTiles(M, N, pool.size(), tileM, tileN);
+
+  const int tilesM = (M + tileM - 1) / tileM;
+  const int tilesN = (N + tileN - 1) / tileN;
+
+  const int *a = A.data();
+  const int *b = B.data();
+  int *c = C.data();
+  const std::ptrdiff_t rsa = A.row_stride(), csa = A.col_stride();
+  const std::ptrdiff_t rsb = B.row_stride(), csb = B.col_stride();
+  const std::ptrdiff_t ldc = C.stride();
+  const bool rowDot = csa == 1 && rsb == 1 && csb != 1 && K >= ROW_DOT_MIN_K;
+
+  pool.parallel_for(tilesM * tilesN, [&](int tile) {
+    const int i0 = (tile / tilesN) * tileM;
+    const int j0 = (tile % tilesN) * tileN;
+    const int m = std::min(tileM, M - i0);
+    const int n = std::min(tileN, N - j0);
+
+    if (rowDot) {
+      gemmRowDot(a + i0 * rsa, rsa, b + j0 * csb, csb, c + i0 * ldc + j0, ldc,
+                 m, n, K, alpha, beta);
+    } else {
+      gemmStrided(a + i0 * rsa, rsa, csa, b + j0 * csb, rsb, csb,
+                  c + i0 * ldc + j0, ldc, m, n, K, alpha, beta);
+    }
+  });
+}
+
+} // namespace
+
+void multiplyMatricesParallel(const DenseMatrix &A, const DenseMatrix &B,
+                              DenseMatrix &C, ThreadPool &pool) {
+  MATRIX_INSTRUMENT("parallel", A.rows(), A.cols(), B.cols(), pool.size());
+
+  if (multiplyVectorShapes(A, B, C, &pool)) {
+    return;
+  }
+
+  if (C.rows() != A.rows() || C.cols() != B.cols()) {
+    C.resize(A.rows(), B.cols());
+  }
+
+  gemmParallel(A, B, C, 1, 0, pool);
+}
+
+void multiplyMatricesParallel(const DenseMatrix &A, const DenseMatrix &B,
+                              DenseMatrix &C) {
+  multiplyMatricesParallel(A, B, C, default_thread_pool());
+}
+
+void multiplyMatricesGemm(const DenseMatrix &A, const DenseMatrix &B,
+                          DenseMatrix &C, int alpha, int beta) {
+  MATRIX_INSTRUMENT("gemm", A.rows(), A.cols(), B.cols(),
+                    default_thread_pool().size());
+
+  if (C.rows() != A.rows() || C.cols() != B.cols()) {
+    if (beta != 0) {
+      throw std::invalid_argument(
+          "multiplyMatricesGemm: C must be A.rows() x B.cols() when beta != 0");
+    }
+    C.resize(A.rows(), B.cols());
+  }
+
+  gemmParallel(A, B, C, alpha, beta, default_thread_pool());
+}
+
+void multiplyMatricesWithoutErrors(const DenseMatrix &A, Transpose transA,
+                                   const DenseMatrix &B, Transpose transB,
+                                   DenseMatrix &C) {
+  const MatrixView<int> opA = transA == Transpose::Yes
+                                  ? MatrixView<int>(A).transposed()
+                                  : MatrixView<int>(A);
+  const MatrixView<int> opB = transB == Transpose::Yes
+                                  ? MatrixView<int>(B).transposed()
+                                  : MatrixView<int>(B);
+  MATRIX_INSTRUMENT("transposed", opA.rows(), opA.cols(), opB.cols(),
+                    default_thread_pool().size());
+
+  if (C.rows() != opA.rows() || C.cols() != opB.cols()) {
+    C.resize(opA.rows(), opB.cols());
+  }
+
+  gemmParallel(opA, opB, C, 1, 0, default_thread_pool());
+}
+
+void multiplyMatricesWithoutErrors(const MatrixView<int> &A,
+                                   const MatrixView<int> &B, DenseMatrix &C) {
+  MATRIX_INSTRUMENT("strided", A.rows(), A.cols(), B.cols(),
+                    default_thread_pool().size());
+
+  if (C.rows() != A.rows() || C.cols() != B.cols()) {
+    C.resize(A.rows(), B.cols());
+  }
+
+  // Any stride is read in place, the packing of every tile gathers it
+  gemmParallel(A, B, C, 1, 0, default_thread_pool());
+}
@@ -0,0 +1,90 @@
+#include "matrix_kernels.h"
+#include <algorithm>
+
+// A * B^T with B^T stored row-major: C[i][j] is the dot product of row i of A
+// and row j of Bt, both contiguous, so no packing is needed at all.
+//
+// Rows are taken 4 at a time from each operand and the 16 dot products of the
+// block run in one pass over k: every element loaded is used 4 times, and the
+// k loop holds 16 independent reductions that the compiler vectorises over k.
+// Blocks of DOT_KC along k keep the 8 rows involved in L1.
+
+namespace {
+
+constexpr int DOT_ROWS = 4;
+
+// 8 rows of DOT_KC ints are 32 KiB, they fit in L1
+constexpr int DOT_KC = 1024;
+
+// acc[i][j] += sum_p a_i[p] * b_j[p] for i < m, j < n (m, n <= DOT_ROWS).
+// Missing rows point to the last valid one, their sums are simply not stored
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+__attribute__((target_clones("avx512f", "avx2", "default")))
+#endif
+void dotBlock(const int *const *a, const int *const *b, int kc,
+              int acc[DOT_ROWS][DOT_ROWS]) {
+  const int *a0 = a[0], *a1 = a[1], *a2 = a[2], *a3 = a[3];
+  const int *b0 = b[0], *b1 = b[1], *b2 = b[2], *b3 = b[3];
+
+  unsigned s00 = 0, s01 = 0, s02 = 0, s03 = 0, s10 = 0, s11 = 0, s12 = 0,
+           s13 = 0, s20 = 0, s21 = 0, s22 = 0, s23 = 0, s30 = 0, s31 = 0,
+           s32 = 0, s33 = 0;
+
+  // Unsigned sums: the wrap around is the one of the other kernels, without
+  // the undefined behaviour that would stop the reductions from vectorising
+  for (int p = 0; p < kc; ++p) {
+    const unsigned x0 = a0[p], x1 = a1[p], x2 = a2[p], x3 = a3[p];
+    const unsigned y0 = b0[p], y1 = b1[p], y2 = b2[p], y3 = b3[p];
+    s00 += x0 * y0; s01 += x0 * y1; s02 += x0 * y2; s03 += x0 * y3;
+    s10 += x1 * y0; s11 += x1 * y1; s12 += x1 * y2; s13 += x1 * y3;
+    s20 += x2 * y0; s21 += x2 * y1; s22 += x2 * y2; s23 += x2 * y3;
+    s30 += x3 * y0; s31 += x3 * y1; s32 += x3 * y2; s33 += x3 * y3;
+  }
+
+  const unsigned sums[DOT_ROWS][DOT_ROWS] = {{s00, s01, s02, s03},
+                                             {s10, s11, s12, s13},
+                                             {s20, s21, s22, s23},
+                                             {s30, s31, s32, s33}};
+  for (int i = 0; i < DOT_ROWS; ++i) {
+    for (int j = 0; j < DOT_ROWS; ++j) {
+      acc[i][j] = static_cast<int>(static_cast<unsigned>(acc[i][j]) + sums[i][j]);
+    }
+  }
+}
+
+} // namespace
+
+void gemmRowDot(const int *A, std::ptrdiff_t lda, const int *Bt,
+                std::ptrdiff_t ldbt, int *C, std::ptrdiff_t ldc, int M, int N,
+                int K, int alpha, int beta) {
+  for (int i0 = 0; i0 < M; i0 += DOT_ROWS) {
+    const int m = std::min(DOT_ROWS, M - i0);
+
+    for (int j0 = 0; j0 < N; j0 += DOT_ROWS) {
+      const int n = std::min(DOT_ROWS, N - j0);
+      int acc[DOT_ROWS][DOT_ROWS] = {};
+
+      for (int k0 = 0; k0 < K; k0 += DOT_KC) {
+        const int kc = std::min(DOT_KC, K - k0);
+
+        const int *a[DOT_ROWS], *b[DOT_ROWS];
+        for (int r = 0; r < DOT_ROWS; ++r) {
+          a[r] = A + (i0 + std::min(r, m - 1)) * lda + k0;
+          b[r] = Bt + (j0 + std::min(r, n - 1)) * ldbt + k0;
+        }
+
+        dotBlock(a, b, kc, acc);
+      }
+
+      for (int i = 0; i < m; ++i) {
+        int *c = C + (i0 + i) * ldc + j0;
+        for (int j = 0; j < n; ++j) {
+          const int ab = alpha == 1 ? acc[i][j] : wrapMul(alpha, acc[i][j]);
+          const int bc = beta == 0 ? 0 : wrapMul(beta, c[j]);
+          c[j] = static_cast<int>(static_cast<unsigned>(ab) +
+                                  static_cast<unsigned>(bc));
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,166 @@
+#include "matrix_multiplication.h"
+#include "matrix_kernels.h"
+#include "matrix_allocator.h"
+#include "matrix_instrumentation.h"
+#include <vector>
+#include <algorithm>
+
+// Strassen-Winograd multiplication: 7 half-size products and 15 additions per
+// level instead of 8 products. All the arithmetic wraps modulo 2^32 (through
+// unsigned), where the recursion is exact, so the result is the same as the
+// reference kernel even when intermediate sums overflow.
+//
+// Odd dimensions are handled by peeling: the recursion runs on the even
+// leading block and the last row / column / rank-1 term are fixed up with
+// plain dot products. Below the cutoff the blocked kernel takes over.
+//
+// The schedule is the one of Boyer, Dumas, Pernet and Zhou: besides the four
+// quadrants of C it needs only three temporaries per level,
+// X (m/2 x k/2), Y (k/2 x n/2) and Z (m/2 x n/2).
+
+namespace {
+
+// Z = X + Y on m x n strided blocks
+void add(const int *X, std::ptrdiff_t ldx, const int *Y, std::ptrdiff_t ldy,
+         int *Z, std::ptrdiff_t ldz, int m, int n) {
+  for (int i = 0; i < m; ++i) {
+    const int *x = X + i * ldx;
+    const int *y = Y + i * ldy;
+    int *z = Z + i * ldz;
+    for (int j = 0; j < n; ++j) {
+      z[j] = static_cast<int>(static_cast<unsigned>(x[j]) +
+                              static_cast<unsigned>(y[j]));
+    }
+  }
+}
+
+// Z = X - Y on m x n strided blocks
+void sub(const int *X, std::ptrdiff_t ldx, const int *Y, std::ptrdiff_t ldy,
+         int *Z, std::ptrdiff_t ldz, int m, int n) {
+  for (int i = 0; i < m; ++i) {
+    const int *x = X + i * ldx;
+    const int *y = Y + i * ldy;
+    int *z = Z + i * ldz;
+    for (int j = 0; j < n; ++j) {
+      z[j] = static_cast<int>(static_cast<unsigned>(x[j]) -
+                              static_cast<unsigned>(y[j]));
+    }
+  }
+}
+
+// C = A * B
+void strassen(const int *A, std::ptrdiff_t lda, const int *B,
+              std::ptrdiff_t ldb, int *C, std::ptrdiff_t ldc, int M, int N,
+              int K, int cutoff) {
+  if (M <= cutoff || N <= cutoff || K <= cutoff) {
+    gemmBlocked(A, lda, B, ldb, C, ldc, M, N, K);
+    return;
+  }
+
+  const int m = M / 2, n = N / 2, k = K / 2;
+
+  const int *A11 = A, *A12 = A + k, *A21 = A + m * lda, *A22 = A21 + k;
+  const int *B11 = B, *B12 = B + n, *B21 = B + k * ldb, *B22 = B21 + n;
+  int *C11 = C, *C12 = C + n, *C21 = C + m * ldc, *C22 = C21 + n;
+
+  // Same sizes at every call with the same shape: served by the buffer pool
+  pooled_vector<int> x(static_cast<size_t>(m) * k);
+  pooled_vector<int> y(static_cast<size_t>(k) * n);
+  pooled_vector<int> z(static_cast<size_t>(m) * n);
+  int *X = x.data(), *Y = y.data(), *Z = z.data();
+
+  // C21 = P7 = (A11 - A21) * (B22 - B12)
+  sub(A11, lda, A21, lda, X, k, m, k);
+  sub(B22, ldb, B12, ldb, Y, n, k, n);
+  strassen(X, k, Y, n, C21, ldc, m, n, k, cutoff);
+
+  // C22 = P5 = (A21 + A22) * (B12 - B11), X = S1, Y = T1
+  add(A21, lda, A22, lda, X, k, m, k);
+  sub(B12, ldb, B11, ldb, Y, n, k, n);
+  strassen(X, k, Y, n, C22, ldc, m, n, k, cutoff);
+
+  // C12 = P6 = (S1 - A11) * (B22 - T1), X = S2, Y = T2
+  sub(X, k, A11, lda, X, k, m, k);
+  sub(B22, ldb, Y, n, Y, n, k, n);
+  strassen(X, k, Y, n, C12, ldc, m, n, k, cutoff);
+
+  // C11 = P3 = (A12 - S2) * B22
+  sub(A12, lda, X, k, X, k, m, k);
+  strassen(X, k, B22, ldb, C11, ldc, m, n, k, cutoff);
+
+  // Z = P1 = A11 * B11
+  strassen(A11, lda, B11, ldb, Z, n, m, n, k, cutoff);
+
+  add(Z, n, C12, ldc, C12, ldc, m, n);     // C12 = U2 = P1 + P6
+  add(C12, ldc, C21, ldc, C21, ldc, m, n); // C21 = U3 = U2 + P7
+  add(C12, ldc, C22, ldc, C12, ldc, m, n); // C12 = U4 = U2 + P5
+  add(C21, ldc, C22, ldc, C22, ldc, m, n); // C22 = U7 = U3 + P5
+  add(C12, ldc, C11, ldc, C12, ldc, m, n); // C12 = U5 = U4 + P3
+
+  // C11 = P4 = A22 * (T2 - B21), then C21 = U6 = U3 - P4
+  sub(Y, n, B21, ldb, Y, n, k, n);
+  strassen(A22, lda, Y, n, C11, ldc, m, n, k, cutoff);
+  sub(C21, ldc, C11, ldc, C21, ldc, m, n);
+
+  // C11 = U1 = P1 + P2 = P1 + A12 * B21
+  strassen(A12, lda, B21, ldb, C11, ldc, m, n, k, cutoff);
+  add(C11, ldc, Z, n, C11, ldc, m, n);
+
+  // Peeling of the odd dimensions, the recursion covered C[0:2m, 0:2n] with
+  // the terms k < 2k only
+  const int m2 = 2 * m, n2 = 2 * n, k2 = 2 * k;
+
+  if (k2 < K) {
+    for (int i = 0; i < m2; ++i) {
+      const unsigned a = A[i * lda + k2];
+      const int *b = B + k2 * ldb;
+      int *c = C + i * ldc;
+      for (int j = 0; j < n2; ++j) {
+        c[j] = static_cast<int>(static_cast<unsigned>(c[j]) +
+                                a * static_cast<unsigned>(b[j]));
+      }
+    }
+  }
+
+  if (n2 < N) {
+    for (int i = 0; i < M; ++i) {
+      unsigned sum = 0;
+      for (int p = 0; p < K; ++p) {
+        sum += static_cast<unsigned>(A[i * lda + p]) *
+               static_cast<unsigned>(B[p * ldb + n2]);
+      }
+      C[i * ldc + n2] = static_cast<int>(sum);
+    }
+  }
+
+  if (m2 < M) {
+    const int *a = A + m2 * lda;
+    int *c = C + m2 * ldc;
+    std::fill(c, c + n2, 0);
+    for (int p = 0; p < K; ++p) {
+      const unsigned ap = a[p];
+      const int *b = B + p * ldb;
+      for (int j = 0; j < n2; ++j) {
+        c[j] = static_cast<int>(static_cast<unsigned>(c[j]) +
+                                ap * static_cast<unsigned>(b[j]));
+      }
+    }
+  }
+}
+
+} // namespace
+
+void multiplyMatricesStrassen(const DenseMatrix &A, const DenseMatrix &B,
+                              DenseMatrix &C, int cutoff) {
+  MATRIX_INSTRUMENT("strassen", A.rows(), A.cols(), B.cols(), 1);
+
+  if (C.rows() != A.rows() || C.cols() != B.cols()) {
+    C.resize(A.rows(), B.cols());
+  }
+
+  // A cutoff below 1 would recurse down to empty blocks
+  cutoff = std::max(cutoff, 1);
+
+  strassen(A.data(), A.stride(), B.data(), B.stride(), C.data(), C.stride(),
+           A.rows(), B.cols(), A.cols(), cutoff);
+}
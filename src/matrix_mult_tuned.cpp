@@ -0,0 +1,106 @@
+#include "matrix_tuning.h"
+#include "matrix_kernels.h"
+#include "matrix_instrumentation.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+// Parameterised kernel of the autotuner (see matrix_tuning.h). Two loop orders:
+//  * Packed: the blocked kernel of matrix_mult_blocked.cpp with the cache
+//    blocks of the configuration instead of the GEMM_* constants
+//  * IKJ: gemmRowsIKJ (matrix_mult_ikj.cpp), no packing at all, which pays
+//    off on shapes too small or too thin to amortise it
+// Both are split in row bands when the configuration asks for threads.
+
+namespace {
+
+constexpr int IKJ_DEFAULT_MC = 64;
+constexpr int IKJ_DEFAULT_KC = 256;
+constexpr int IKJ_DEFAULT_NC = 1024;
+
+// Rows [i0, i0 + m) of C
+void runBand(const DenseMatrix &A, const DenseMatrix &B, DenseMatrix &C,
+             int i0, int m, const TuningConfig &config) {
+  const int N = B.cols();
+  const int K = A.cols();
+
+  if (config.order == TunedLoopOrder::IKJ) {
+    std::vector<const int *> a(m), b(K);
+    std::vector<int *> c(m);
+    for (int i = 0; i < m; ++i) {
+      a[i] = A.row(i0 + i);
+      c[i] = C.row(i0 + i);
+    }
+    for (int k = 0; k < K; ++k) {
+      b[k] = B.row(k);
+    }
+
+    const int unroll = config.unroll >= 4 ? 4 : config.unroll >= 2 ? 2 : 1;
+    gemmRowsIKJ(a.data(), b.data(), c.data(), m, N, K,
+                config.mc > 0 ? config.mc : IKJ_DEFAULT_MC,
+                config.kc > 0 ? config.kc : IKJ_DEFAULT_KC,
+                config.nc > 0 ? config.nc : IKJ_DEFAULT_NC, unroll, false);
+    return;
+  }
+
+  GemmBlocking blocking;
+  if (config.mc > 0) {
+    blocking.mc = (config.mc + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+  }
+  if (config.kc > 0) {
+    blocking.kc = config.kc;
+  }
+  if (config.nc > 0) {
+    blocking.nc = (config.nc + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+  }
+
+  gemmStrided(A.row(i0), A.stride(), 1, B.data(), B.stride(), 1, C.row(i0),
+              C.stride(), m, N, K, 1, 0, blocking);
+}
+
+} // namespace
+
+std::string TuningConfig::to_string() const {
+  std::ostringstream out;
+  out << (order == TunedLoopOrder::IKJ ? "ikj" : "packed") << " mc=" << mc
+      << " kc=" << kc << " nc=" << nc << " unroll=" << unroll
+      << " threads=" << threads;
+  return out.str();
+}
+
+bool operator==(const TuningConfig &a, const TuningConfig &b) {
+  return a.order == b.order && a.mc == b.mc && a.kc == b.kc && a.nc == b.nc &&
+         a.unroll == b.unroll && a.threads == b.threads;
+}
+
+void multiplyMatricesTuned(const DenseMatrix &A, const DenseMatrix &B,
+                           DenseMatrix &C, const TuningConfig &config) {
+  const int M = A.rows();
+  MATRIX_INSTRUMENT("tuned", M, A.cols(), B.cols(),
+                    std::max(config.threads, 1));
+
+  if (C.rows() != M || C.cols() != B.cols()) {
+    C.resize(M, B.cols());
+  }
+
+  if (M == 0 || B.cols() == 0) {
+    return;
+  }
+
+  if (config.threads <= 1) {
+    runBand(A, B, C, 0, M, config);
+    return;
+  }
+
+  // Bands a multiple of the micro-kernel block (and so of any unroll factor)
+  const int bands = 4 * config.threads;
+  int height = (M + bands - 1) / bands;
+  height = (height + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+  const int tasks = (M + height - 1) / height;
+
+  default_thread_pool().parallel_for(tasks, [&](int t) {
+    const int i0 = t * height;
+    runBand(A, B, C, i0, std::min(height, M - i0), config);
+  });
+}
@@ -0,0 +1,299 @@
+#include "typed_multiplication.h"
+#include "simd_dispatch.h"
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// Fast paths of multiplyMatricesTyped, see typed_multiplication.h.
+//
+// Narrow integers: B is packed once as int16 pairs (B[2p][j], B[2p+1][j]) in
+// the two halves of an int32 lane, and the matching pair of A is broadcast.
+// pmaddwd / vpdpwssd then perform two multiply-accumulates per int32 lane,
+// twice the work of the int32 micro-kernels at half their bandwidth. int8 is
+// widened to int16 while packing, so the kernel moves as many bytes as for
+// int16: only the operands in memory are a quarter of their int32 size.
+
+namespace {
+
+#ifdef MATRIX_X86_SIMD
+
+// Columns of the packed B are padded to a multiple of the widest block
+constexpr int NARROW_BLOCK = 64;
+
+bool cpuHas(SimdLevel level) {
+  return static_cast<int>(active_simd_level()) >= static_cast<int>(level);
+}
+
+bool cpuHasVNNI() {
+  static const bool vnni = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512vnni") != 0;
+  }();
+  return vnni && cpuHas(SimdLevel::AVX512);
+}
+
+bool cpuHasFMA() {
+  static const bool fma = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("fma") != 0;
+  }();
+  return fma && cpuHas(SimdLevel::AVX2);
+}
+
+int32_t pair(int16_t lo, int16_t hi) {
+  return static_cast<int32_t>(static_cast<uint16_t>(lo) |
+                              (static_cast<uint32_t>(static_cast<uint16_t>(hi)) << 16));
+}
+
+// packed[(p*ldp + j)*2 + h] = B[2p + h][j], zero outside of B
+template <typename T>
+void packPairs(const BasicDenseMatrix<T> &B, int ldp, std::vector<int16_t> &packed) {
+  const int K = B.rows();
+  const int N = B.cols();
+  const int pairs = (K + 1) / 2;
+
+  packed.assign(static_cast<size_t>(pairs) * ldp * 2, 0);
+
+  for (int k = 0; k < K; ++k) {
+    const T *b = B.row(k);
+    int16_t *dst = packed.data() + static_cast<size_t>(k / 2) * ldp * 2 + (k % 2);
+    for (int j = 0; j < N; ++j) {
+      dst[2 * j] = b[j];
+    }
+  }
+}
+
+template <typename T> int16_t elementOr0(const T *a, int k, int K) {
+  return k < K ? static_cast<int16_t>(a[k]) : int16_t(0);
+}
+
+// One row of C, 32 columns at a time with four 8 lane accumulators
+template <typename T>
+__attribute__((target("avx2"))) void
+narrowRowAVX2(const T *a, int K, const int16_t *packed, int ldp, int32_t *c, int N) {
+  const int pairs = (K + 1) / 2;
+  alignas(32) int32_t tile[32];
+
+  for (int j0 = 0; j0 < N; j0 += 32) {
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+    __m256i acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+
+    for (int p = 0; p < pairs; ++p) {
+      const __m256i ap = _mm256_set1_epi32(pair(elementOr0(a, 2 * p, K), elementOr0(a, 2 * p + 1, K)));
+      const __m256i *b = reinterpret_cast<const __m256i *>(packed + (static_cast<size_t>(p) * ldp + j0) * 2);
+
+      acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(ap, _mm256_loadu_si256(b)));
+      acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(ap, _mm256_loadu_si256(b + 1)));
+      acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(ap, _mm256_loadu_si256(b + 2)));
+      acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(ap, _mm256_loadu_si256(b + 3)));
+    }
+
+    _mm256_store_si256(reinterpret_cast<__m256i *>(tile), acc0);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(tile + 8), acc1);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(tile + 16), acc2);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(tile + 24), acc3);
+    std::copy(tile, tile + std::min(32, N - j0), c + j0);
+  }
+}
+
+// Same with 16 lane accumulators and the VNNI dot product
+template <typename T>
+__attribute__((target("avx512f,avx512vnni"))) void
+narrowRowVNNI(const T *a, int K, const int16_t *packed, int ldp, int32_t *c, int N) {
+  const int pairs = (K + 1) / 2;
+  alignas(64) int32_t tile[64];
+
+  for (int j0 = 0; j0 < N; j0 += 64) {
+    __m512i acc0 = _mm512_setzero_si512(), acc1 = _mm512_setzero_si512();
+    __m512i acc2 = _mm512_setzero_si512(), acc3 = _mm512_setzero_si512();
+
+    for (int p = 0; p < pairs; ++p) {
+      const __m512i ap = _mm512_set1_epi32(pair(elementOr0(a, 2 * p, K), elementOr0(a, 2 * p + 1, K)));
+      const int16_t *b = packed + (static_cast<size_t>(p) * ldp + j0) * 2;
+
+      acc0 = _mm512_dpwssd_epi32(acc0, ap, _mm512_loadu_si512(b));
+      acc1 = _mm512_dpwssd_epi32(acc1, ap, _mm512_loadu_si512(b + 32));
+      acc2 = _mm512_dpwssd_epi32(acc2, ap, _mm512_loadu_si512(b + 64));
+      acc3 = _mm512_dpwssd_epi32(acc3, ap, _mm512_loadu_si512(b + 96));
+    }
+
+    _mm512_store_si512(tile, acc0);
+    _mm512_store_si512(tile + 16, acc1);
+    _mm512_store_si512(tile + 32, acc2);
+    _mm512_store_si512(tile + 48, acc3);
+    std::copy(tile, tile + std::min(64, N - j0), c + j0);
+  }
+}
+
+template <typename T>
+bool narrowSIMD(const BasicDenseMatrix<T> &A, const BasicDenseMatrix<T> &B,
+                BasicDenseMatrix<int32_t> &C) {
+  const bool vnni = cpuHasVNNI();
+  if (!vnni && !cpuHas(SimdLevel::AVX2)) {
+    return false;
+  }
+
+  const int N = B.cols();
+  const int ldp = (N + NARROW_BLOCK - 1) / NARROW_BLOCK * NARROW_BLOCK;
+
+  thread_local std::vector<int16_t> packed;
+  packPairs(B, ldp, packed);
+
+  for (int i = 0; i < A.rows(); ++i) {
+    if (vnni) {
+      narrowRowVNNI(A.row(i), A.cols(), packed.data(), ldp, C.row(i), N);
+    } else {
+      narrowRowAVX2(A.row(i), A.cols(), packed.data(), ldp, C.row(i), N);
+    }
+  }
+
+  return true;
+}
+
+// Rows of C with 4 registers of fused multiply-adds per k, the columns past
+// the last full block go through the scalar fma
+template <typename T>
+void fmaTail(const T *a, const BasicDenseMatrix<T> &B, T *c, int j0, int N) {
+  for (int j = j0; j < N; ++j) {
+    T sum = T(0);
+    for (int k = 0; k < B.rows(); ++k) {
+      sum = std::fma(a[k], B(k, j), sum);
+    }
+    c[j] = sum;
+  }
+}
+
+__attribute__((target("avx2,fma"))) void
+fmaFloat(const BasicDenseMatrix<float> &A, const BasicDenseMatrix<float> &B,
+         BasicDenseMatrix<float> &C) {
+  const int K = B.rows();
+  const int N = C.cols();
+
+  for (int i = 0; i < A.rows(); ++i) {
+    const float *a = A.row(i);
+    float *c = C.row(i);
+    int j0 = 0;
+
+    for (; j0 + 32 <= N; j0 += 32) {
+      __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+      __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+
+      for (int k = 0; k < K; ++k) {
+        const __m256 ak = _mm256_set1_ps(a[k]);
+        const float *b = B.row(k) + j0;
+        acc0 = _mm256_fmadd_ps(ak, _mm256_loadu_ps(b), acc0);
+        acc1 = _mm256_fmadd_ps(ak, _mm256_loadu_ps(b + 8), acc1);
+        acc2 = _mm256_fmadd_ps(ak, _mm256_loadu_ps(b + 16), acc2);
+        acc3 = _mm256_fmadd_ps(ak, _mm256_loadu_ps(b + 24), acc3);
+      }
+
+      _mm256_storeu_ps(c + j0, acc0);
+      _mm256_storeu_ps(c + j0 + 8, acc1);
+      _mm256_storeu_ps(c + j0 + 16, acc2);
+      _mm256_storeu_ps(c + j0 + 24, acc3);
+    }
+
+    fmaTail(a, B, c, j0, N);
+  }
+}
+
+__attribute__((target("avx2,fma"))) void
+fmaDouble(const BasicDenseMatrix<double> &A, const BasicDenseMatrix<double> &B,
+          BasicDenseMatrix<double> &C) {
+  const int K = B.rows();
+  const int N = C.cols();
+
+  for (int i = 0; i < A.rows(); ++i) {
+    const double *a = A.row(i);
+    double *c = C.row(i);
+    int j0 = 0;
+
+    for (; j0 + 16 <= N; j0 += 16) {
+      __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+      __m256d acc2 = _mm256_setzero_pd(), acc3 = _mm256_setzero_pd();
+
+      for (int k = 0; k < K; ++k) {
+        const __m256d ak = _mm256_set1_pd(a[k]);
+        const double *b = B.row(k) + j0;
+        acc0 = _mm256_fmadd_pd(ak, _mm256_loadu_pd(b), acc0);
+        acc1 = _mm256_fmadd_pd(ak, _mm256_loadu_pd(b + 4), acc1);
+        acc2 = _mm256_fmadd_pd(ak, _mm256_loadu_pd(b + 8), acc2);
+        acc3 = _mm256_fmadd_pd(ak, _mm256_loadu_pd(b + 12), acc3);
+      }
+
+      _mm256_storeu_pd(c + j0, acc0);
+      _mm256_storeu_pd(c + j0 + 4, acc1);
+      _mm256_storeu_pd(c + j0 + 8, acc2);
+      _mm256_storeu_pd(c + j0 + 12, acc3);
+    }
+
+    fmaTail(a, B, c, j0, N);
+  }
+}
+
+#endif // MATRIX_X86_SIMD
+
+template <typename T, typename Acc>
+void prepare(const BasicDenseMatrix<T> &A, const BasicDenseMatrix<T> &B,
+             BasicDenseMatrix<Acc> &C) {
+  if (C.rows() != A.rows() || C.cols() != B.cols()) {
+    C.resize(A.rows(), B.cols());
+  }
+}
+
+} // namespace
+
+void multiplyMatricesNarrow(const BasicDenseMatrix<int8_t> &A,
+                            const BasicDenseMatrix<int8_t> &B,
+                            BasicDenseMatrix<int32_t> &C) {
+  prepare(A, B, C);
+#ifdef MATRIX_X86_SIMD
+  if (narrowSIMD(A, B, C)) {
+    return;
+  }
+#endif
+  multiplyMatricesGeneric<int8_t, int32_t>(A, B, C);
+}
+
+void multiplyMatricesNarrow(const BasicDenseMatrix<int16_t> &A,
+                            const BasicDenseMatrix<int16_t> &B,
+                            BasicDenseMatrix<int32_t> &C) {
+  prepare(A, B, C);
+#ifdef MATRIX_X86_SIMD
+  if (narrowSIMD(A, B, C)) {
+    return;
+  }
+#endif
+  multiplyMatricesGeneric<int16_t, int32_t>(A, B, C);
+}
+
+void multiplyMatricesFMA(const BasicDenseMatrix<float> &A,
+                         const BasicDenseMatrix<float> &B,
+                         BasicDenseMatrix<float> &C) {
+  prepare(A, B, C);
+#ifdef MATRIX_X86_SIMD
+  if (cpuHasFMA()) {
+    fmaFloat(A, B, C);
+    return;
+  }
+#endif
+  multiplyMatricesGeneric<float, float>(A, B, C);
+}
+
+void multiplyMatricesFMA(const BasicDenseMatrix<double> &A,
+                         const BasicDenseMatrix<double> &B,
+                         BasicDenseMatrix<double> &C) {
+  prepare(A, B, C);
+#ifdef MATRIX_X86_SIMD
+  if (cpuHasFMA()) {
+    fmaDouble(A, B, C);
+    return;
+  }
+#endif
+  multiplyMatricesGeneric<double, double>(A, B, C);
+}
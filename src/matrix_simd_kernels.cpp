@@ -0,0 +1,231 @@
+#include "matrix_kernels.h"
+#include "simd_dispatch.h"
+#include <atomic>
+
+// int32 multiply-accumulate micro-kernels for the blocked engine.
+//
+// Every kernel computes the same MR x NR = 4 x 16 tile with the same
+// wrap-around int32 arithmetic, the only difference is how many lanes are
+// processed by one instruction: 1 (scalar), 4 (SSE4.1 pmulld), 8 (AVX2) or
+// 16 (AVX-512). The SIMD versions are compiled with per-function target
+// attributes, so the binary runs everywhere and the dispatcher picks the
+// widest one the CPU reports at startup.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+static_assert(GEMM_MR == 4 && GEMM_NR == 16,
+              "the SIMD micro-kernels are written for a 4x16 tile");
+
+namespace {
+
+void microKernelScalar(int kc, const int *a, const int *b, int *C,
+                       std::ptrdiff_t ldc, bool accumulate) {
+  // Unsigned, so that the wrap-around is defined behaviour as in the SIMD
+  // lanes
+  unsigned acc[GEMM_MR][GEMM_NR] = {};
+
+  for (int p = 0; p < kc; ++p) {
+    for (int i = 0; i < GEMM_MR; ++i) {
+      const unsigned ai = a[p * GEMM_MR + i];
+      for (int j = 0; j < GEMM_NR; ++j) {
+        acc[i][j] += ai * static_cast<unsigned>(b[p * GEMM_NR + j]);
+      }
+    }
+  }
+
+  for (int i = 0; i < GEMM_MR; ++i) {
+    int *c = C + i * ldc;
+    for (int j = 0; j < GEMM_NR; ++j) {
+      c[j] = static_cast<int>(
+          accumulate ? static_cast<unsigned>(c[j]) + acc[i][j] : acc[i][j]);
+    }
+  }
+}
+
+#ifdef MATRIX_X86_SIMD
+
+// 4 rows x 4 registers of 4 lanes: all 16 xmm registers hold accumulators,
+// the operands are reloaded from L1 every step
+__attribute__((target("sse4.1"))) void
+microKernelSSE41(int kc, const int *a, const int *b, int *C,
+                 std::ptrdiff_t ldc, bool accumulate) {
+  __m128i acc[GEMM_MR][4];
+  for (int i = 0; i < GEMM_MR; ++i) {
+    for (int v = 0; v < 4; ++v) {
+      acc[i][v] = _mm_setzero_si128();
+    }
+  }
+
+  for (int p = 0; p < kc; ++p) {
+    const int *bp = b + p * GEMM_NR;
+    for (int i = 0; i < GEMM_MR; ++i) {
+      const __m128i ai = _mm_set1_epi32(a[p * GEMM_MR + i]);
+      for (int v = 0; v < 4; ++v) {
+        const __m128i bv =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(bp + 4 * v));
+        acc[i][v] = _mm_add_epi32(acc[i][v], _mm_mullo_epi32(ai, bv));
+      }
+    }
+  }
+
+  for (int i = 0; i < GEMM_MR; ++i) {
+    __m128i *c = reinterpret_cast<__m128i *>(C + i * ldc);
+    for (int v = 0; v < 4; ++v) {
+      __m128i result = acc[i][v];
+      if (accumulate) {
+        result = _mm_add_epi32(result, _mm_loadu_si128(c + v));
+      }
+      _mm_storeu_si128(c + v, result);
+    }
+  }
+}
+
+// 4 rows x 2 registers of 8 lanes, B is loaded once per k step and shared by
+// the four broadcasts of A
+__attribute__((target("avx2"))) void
+microKernelAVX2(int kc, const int *a, const int *b, int *C,
+                std::ptrdiff_t ldc, bool accumulate) {
+  __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+  __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+  __m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+  __m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+
+  for (int p = 0; p < kc; ++p) {
+    const __m256i b0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+    const __m256i b1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + 8));
+
+    __m256i ai = _mm256_set1_epi32(a[0]);
+    c00 = _mm256_add_epi32(c00, _mm256_mullo_epi32(ai, b0));
+    c01 = _mm256_add_epi32(c01, _mm256_mullo_epi32(ai, b1));
+    ai = _mm256_set1_epi32(a[1]);
+    c10 = _mm256_add_epi32(c10, _mm256_mullo_epi32(ai, b0));
+    c11 = _mm256_add_epi32(c11, _mm256_mullo_epi32(ai, b1));
+    ai = _mm256_set1_epi32(a[2]);
+    c20 = _mm256_add_epi32(c20, _mm256_mullo_epi32(ai, b0));
+    c21 = _mm256_add_epi32(c21, _mm256_mullo_epi32(ai, b1));
+    ai = _mm256_set1_epi32(a[3]);
+    c30 = _mm256_add_epi32(c30, _mm256_mullo_epi32(ai, b0));
+    c31 = _mm256_add_epi32(c31, _mm256_mullo_epi32(ai, b1));
+
+    a += GEMM_MR;
+    b += GEMM_NR;
+  }
+
+  const __m256i acc[GEMM_MR][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}};
+
+  for (int i = 0; i < GEMM_MR; ++i) {
+    __m256i *c = reinterpret_cast<__m256i *>(C + i * ldc);
+    for (int v = 0; v < 2; ++v) {
+      __m256i result = acc[i][v];
+      if (accumulate) {
+        result = _mm256_add_epi32(result, _mm256_loadu_si256(c + v));
+      }
+      _mm256_storeu_si256(c + v, result);
+    }
+  }
+}
+
+// One 16 lane register per row of the tile
+__attribute__((target("avx512f"))) void
+microKernelAVX512(int kc, const int *a, const int *b, int *C,
+                  std::ptrdiff_t ldc, bool accumulate) {
+  __m512i c0 = _mm512_setzero_si512(), c1 = _mm512_setzero_si512();
+  __m512i c2 = _mm512_setzero_si512(), c3 = _mm512_setzero_si512();
+
+  for (int p = 0; p < kc; ++p) {
+    const __m512i bv = _mm512_loadu_si512(b);
+
+    c0 = _mm512_add_epi32(c0, _mm512_mullo_epi32(_mm512_set1_epi32(a[0]), bv));
+    c1 = _mm512_add_epi32(c1, _mm512_mullo_epi32(_mm512_set1_epi32(a[1]), bv));
+    c2 = _mm512_add_epi32(c2, _mm512_mullo_epi32(_mm512_set1_epi32(a[2]), bv));
+    c3 = _mm512_add_epi32(c3, _mm512_mullo_epi32(_mm512_set1_epi32(a[3]), bv));
+
+    a += GEMM_MR;
+    b += GEMM_NR;
+  }
+
+  const __m512i acc[GEMM_MR] = {c0, c1, c2, c3};
+
+  for (int i = 0; i < GEMM_MR; ++i) {
+    int *c = C + i * ldc;
+    __m512i result = acc[i];
+    if (accumulate) {
+      result = _mm512_add_epi32(result, _mm512_loadu_si512(c));
+    }
+    _mm512_storeu_si512(c, result);
+  }
+}
+
+#endif // MATRIX_X86_SIMD
+
+SimdLevel detectSimdLevel() {
+#ifdef MATRIX_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return SimdLevel::AVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return SimdLevel::SSE41;
+  }
+#endif
+  return SimdLevel::Scalar;
+}
+
+MicroKernel kernelFor(SimdLevel level) {
+  switch (level) {
+#ifdef MATRIX_X86_SIMD
+  case SimdLevel::AVX512:
+    return microKernelAVX512;
+  case SimdLevel::AVX2:
+    return microKernelAVX2;
+  case SimdLevel::SSE41:
+    return microKernelSSE41;
+#endif
+  default:
+    return microKernelScalar;
+  }
+}
+
+std::atomic<SimdLevel> &activeLevel() {
+  static std::atomic<SimdLevel> level(detected_simd_level());
+  return level;
+}
+
+} // namespace
+
+SimdLevel detected_simd_level() {
+  static const SimdLevel level = detectSimdLevel();
+  return level;
+}
+
+SimdLevel active_simd_level() { return activeLevel().load(); }
+
+void set_simd_level(SimdLevel level) {
+  const SimdLevel detected = detected_simd_level();
+  activeLevel().store(static_cast<int>(level) > static_cast<int>(detected)
+                          ? detected
+                          : level);
+}
+
+const char *simd_level_name(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::AVX512:
+    return "avx512";
+  case SimdLevel::AVX2:
+    return "avx2";
+  case SimdLevel::SSE41:
+    return "sse4.1";
+  default:
+    return "scalar";
+  }
+}
+
+MicroKernel activeMicroKernel() { return kernelFor(active_simd_level()); }
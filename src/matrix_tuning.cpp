@@ -0,0 +1,379 @@
+#include "matrix_tuning.h"
+#include "matrix_kernels.h"
+#include "matrix_utils.h"
+#include "thread_pool.h"
+#include <map>
+#include <set>
+#include <tuple>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace {
+
+// Only the int32 kernels are tuned, the dtype is kept in the key for the other types to come
+const char *const TUNED_DTYPE = "int32";
+
+// In autotune mode, smaller shapes (2 * rowsA * colsA * colsB operations) are not worth a tuning run
+constexpr double AUTOTUNE_MIN_OPS = 1 << 24;
+
+// Products of at least this many operations also try the default thread pool
+constexpr double TUNE_THREADS_MIN_OPS = 1 << 22;
+
+// Largest blocks accepted from the cache file, well above every candidate: the packed panels
+// of a block are allocated up front, so a corrupted entry must not size them
+constexpr int TUNED_MAX_MC = 1024;
+constexpr int TUNED_MAX_KC = 1024;
+constexpr int TUNED_MAX_NC = 8192;
+constexpr int TUNED_MAX_THREADS = 1024;
+
+
+struct TuningEntry {
+	TuningConfig config;
+	double gops = 0.0;
+};
+
+// (cpu model, dtype, rowsA, colsA, colsB)
+using TuningKey = std::tuple<std::string, std::string, int, int, int>;
+
+
+struct TuningCache {
+	std::mutex mutex;
+	std::string path;
+	bool loaded = false;
+	std::map<TuningKey, TuningEntry> entries;
+
+	// Shapes being tuned in autotune mode, not tuned twice at once
+	std::set<std::tuple<int, int, int>> in_progress;
+};
+
+
+std::string
+default_cache_path() {
+	if (const char *path = std::getenv("MATRIX_TUNING_CACHE")) return path;
+	if (const char *home = std::getenv("HOME")) return std::string(home) + "/.matrix_tuning_cache";
+	return ".matrix_tuning_cache";
+}
+
+
+TuningCache &
+tuning_cache() {
+	static TuningCache *cache = new TuningCache{};
+	return *cache;
+}
+
+
+// One entry per line: cpu model|dtype|rowsA colsA colsB|order mc kc nc unroll threads|GOP/s
+bool
+parse_entry(const std::string &line, TuningKey &key, TuningEntry &entry) {
+	std::vector<std::string> fields;
+	std::stringstream in(line);
+	for (std::string field; std::getline(in, field, '|');) fields.push_back(field);
+	if (fields.size() != 5) return false;
+
+	int rowsA, colsA, colsB;
+	if (!(std::istringstream(fields[2]) >> rowsA >> colsA >> colsB)) return false;
+
+	std::string order;
+	TuningConfig &config = entry.config;
+	if (!(std::istringstream(fields[3]) >> order >> config.mc >> config.kc >> config.nc >> config.unroll >> config.threads)) return false;
+
+	if (order == "ikj") config.order = TunedLoopOrder::IKJ;
+	else if (order == "packed") config.order = TunedLoopOrder::Packed;
+	else return false;
+
+	if (config.mc < 0 || config.mc > TUNED_MAX_MC || config.kc < 0 || config.kc > TUNED_MAX_KC || config.nc < 0 || config.nc > TUNED_MAX_NC) return false;
+	if (config.unroll != 1 && config.unroll != 2 && config.unroll != 4) return false;
+	if (config.threads < 1 || config.threads > TUNED_MAX_THREADS) return false;
+
+	// The candidates of the packed order are whole micro-kernel blocks
+	if (config.order == TunedLoopOrder::Packed && (config.mc % GEMM_MR != 0 || config.nc % GEMM_NR != 0)) return false;
+	if (rowsA <= 0 || colsA <= 0 || colsB <= 0) return false;
+
+	entry.gops = std::atof(fields[4].c_str());
+	key = TuningKey(fields[0], fields[1], rowsA, colsA, colsB);
+	return true;
+}
+
+
+// Read the file once, the caller holds the lock. A missing file is an empty cache
+void
+ensure_loaded(TuningCache &cache) {
+	if (cache.loaded) return;
+	cache.loaded = true;
+
+	if (cache.path.empty()) cache.path = default_cache_path();
+
+	std::ifstream in(cache.path);
+	for (std::string line; std::getline(in, line);) {
+		if (line.empty() || line[0] == '#') continue;
+
+		TuningKey key;
+		TuningEntry entry;
+		if (parse_entry(line, key, entry)) cache.entries[key] = entry;
+	}
+}
+
+
+void
+save_locked(TuningCache &cache) {
+	const std::string temporary = cache.path + ".tmp";
+
+	{
+		std::ofstream out(temporary, std::ios::trunc);
+		if (!out) throw std::runtime_error("save_tuning_cache: cannot write " + temporary);
+
+		out << "# cpu model|dtype|rowsA colsA colsB|order mc kc nc unroll threads|GOP/s\n";
+		for (const auto &item : cache.entries) {
+			const TuningKey &key = item.first;
+			const TuningConfig &config = item.second.config;
+
+			out << std::get<0>(key) << '|' << std::get<1>(key) << '|'
+				<< std::get<2>(key) << ' ' << std::get<3>(key) << ' ' << std::get<4>(key) << '|'
+				<< (config.order == TunedLoopOrder::IKJ ? "ikj" : "packed") << ' '
+				<< config.mc << ' ' << config.kc << ' ' << config.nc << ' ' << config.unroll << ' ' << config.threads << '|'
+				<< item.second.gops << '\n';
+		}
+
+		if (!out) throw std::runtime_error("save_tuning_cache: cannot write " + temporary);
+	}
+
+	// Readers of the file never see it half written
+	if (std::rename(temporary.c_str(), cache.path.c_str()) != 0) {
+		std::remove(temporary.c_str());
+		throw std::runtime_error("save_tuning_cache: cannot replace " + cache.path);
+	}
+}
+
+
+bool
+autotune_mode() {
+	const char *env = std::getenv("MATRIX_AUTOTUNE");
+	return env && *env && std::string(env) != "0";
+}
+
+
+int
+round_up(const int n, const int multiple) {
+	return (n + multiple - 1) / multiple * multiple;
+}
+
+
+template <typename Multiply>
+double
+best_seconds(const int repetitions, Multiply multiply) {
+	multiply();
+
+	double best = -1.0;
+	for (int r = 0; r < repetitions; ++r) {
+		const auto start = std::chrono::steady_clock::now();
+		multiply();
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (best < 0 || seconds < best) best = seconds;
+	}
+	return best;
+}
+
+}
+
+
+std::vector<TuningConfig>
+tuning_candidates(const int rowsA, const int colsA, const int colsB) {
+	// Blocks larger than the matrix all behave the same, they are clamped to its size (rounded
+	// up to the micro-kernel block for Packed) and the duplicates dropped
+	const int packed_blocks[][3] = {{128, 256, 2048}, {64, 256, 2048}, {128, 512, 1024}, {256, 128, 4096}, {64, 128, 1024}};
+	const int ikj_blocks[][3] = {{64, 256, 1024}, {32, 128, 512}, {256, 64, 256}};
+	const int unrolls[] = {1, 2, 4};
+
+	std::vector<int> thread_counts = {1};
+	const int pool_threads = default_thread_pool().size();
+	if (pool_threads > 1 && 2.0 * rowsA * colsA * colsB >= TUNE_THREADS_MIN_OPS) thread_counts.push_back(pool_threads);
+
+	const int M = std::max(rowsA, 1), K = std::max(colsA, 1), N = std::max(colsB, 1);
+
+	std::vector<TuningConfig> candidates;
+	auto add = [&](const TuningConfig &config) {
+		if (std::find(candidates.begin(), candidates.end(), config) == candidates.end()) candidates.push_back(config);
+	};
+
+	for (const int threads : thread_counts) {
+		for (const auto &block : packed_blocks) {
+			TuningConfig config;
+			config.order = TunedLoopOrder::Packed;
+			config.mc = std::min(block[0], round_up(M, 4));
+			config.kc = std::min(block[1], K);
+			config.nc = std::min(block[2], round_up(N, 16));
+			config.threads = threads;
+			add(config);
+		}
+
+		for (const auto &block : ikj_blocks) {
+			for (const int unroll : unrolls) {
+				TuningConfig config;
+				config.order = TunedLoopOrder::IKJ;
+				config.mc = std::min(block[0], M);
+				config.kc = std::min(block[1], K);
+				config.nc = std::min(block[2], N);
+				config.unroll = unroll;
+				config.threads = threads;
+				add(config);
+			}
+		}
+	}
+
+	return candidates;
+}
+
+
+AutotuneResult
+autotune_multiplication(const int rowsA, const int colsA, const int colsB, const AutotuneOptions &options) {
+	if (rowsA <= 0 || colsA <= 0 || colsB <= 0)
+		throw std::invalid_argument("autotune_multiplication: the dimensions must be positive");
+
+	DenseMatrix A, B, C;
+	build_random_matrix(A, rowsA, colsA, 1);
+	build_random_matrix(B, colsA, colsB, 2);
+
+	const double operations = 2.0 * rowsA * colsA * colsB;
+
+	AutotuneResult best;
+	for (const TuningConfig &config : tuning_candidates(rowsA, colsA, colsB)) {
+		const double seconds = best_seconds(std::max(options.repetitions, 1), [&] {
+			multiplyMatricesTuned(A, B, C, config);
+		});
+
+		const double gops = seconds > 0 ? operations / seconds * 1e-9 : 0.0;
+		if (gops > best.gops) best = {config, gops};
+	}
+
+	TuningCache &cache = tuning_cache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	ensure_loaded(cache);
+
+	cache.entries[TuningKey(cpu_model_name(), TUNED_DTYPE, rowsA, colsA, colsB)] = {best.config, best.gops};
+	if (options.save) save_locked(cache);
+
+	return best;
+}
+
+
+bool
+find_tuned_config(const int rowsA, const int colsA, const int colsB, TuningConfig &config) {
+	TuningCache &cache = tuning_cache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	ensure_loaded(cache);
+
+	const auto found = cache.entries.find(TuningKey(cpu_model_name(), TUNED_DTYPE, rowsA, colsA, colsB));
+	if (found == cache.entries.end()) return false;
+
+	config = found->second.config;
+	return true;
+}
+
+
+bool
+tuned_config_for(const int rowsA, const int colsA, const int colsB, TuningConfig &config) {
+	if (find_tuned_config(rowsA, colsA, colsB, config)) return true;
+	if (!autotune_mode() || 2.0 * rowsA * colsA * colsB < AUTOTUNE_MIN_OPS) return false;
+
+	TuningCache &cache = tuning_cache();
+	const std::tuple<int, int, int> shape(rowsA, colsA, colsB);
+	{
+		std::lock_guard<std::mutex> lock(cache.mutex);
+		if (!cache.in_progress.insert(shape).second) return false;
+	}
+
+	AutotuneOptions options;
+	options.save = false;
+	config = autotune_multiplication(rowsA, colsA, colsB, options).config;
+
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.in_progress.erase(shape);
+
+	// An unwritable cache file must not fail the multiplication, the winner stays in memory
+	try {
+		save_locked(cache);
+	} catch (const std::runtime_error &) {
+	}
+
+	return true;
+}
+
+
+const std::string &
+cpu_model_name() {
+	static const std::string model = [] {
+		std::ifstream in("/proc/cpuinfo");
+		for (std::string line; std::getline(in, line);) {
+			if (line.compare(0, 10, "model name") != 0) continue;
+
+			const size_t colon = line.find(':');
+			if (colon == std::string::npos) break;
+
+			const size_t begin = line.find_first_not_of(" \t", colon + 1);
+			std::string name = begin == std::string::npos ? "" : line.substr(begin);
+			// The separator of the cache file
+			std::replace(name.begin(), name.end(), '|', '/');
+			if (!name.empty()) return name;
+		}
+		return std::string("unknown");
+	}();
+	return model;
+}
+
+
+std::string
+tuning_cache_path() {
+	TuningCache &cache = tuning_cache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	if (cache.path.empty()) cache.path = default_cache_path();
+	return cache.path;
+}
+
+
+void
+set_tuning_cache_path(const std::string &path) {
+	TuningCache &cache = tuning_cache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.path = path;
+	cache.entries.clear();
+	cache.loaded = false;
+}
+
+
+void
+clear_tuning_cache() {
+	TuningCache &cache = tuning_cache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.entries.clear();
+	cache.loaded = true;
+}
+
+
+void
+save_tuning_cache() {
+	TuningCache &cache = tuning_cache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	ensure_loaded(cache);
+	save_locked(cache);
+}
+
+
+size_t
+tuning_cache_size() {
+	TuningCache &cache = tuning_cache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	ensure_loaded(cache);
+
+	size_t count = 0;
+	for (const auto &item : cache.entries) {
+		if (std::get<0>(item.first) == cpu_model_name()) ++count;
+	}
+	return count;
+}
@@ -0,0 +1,316 @@
+#include "out_of_core.h"
+#include "matrix_multiplication.h"
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace {
+
+const char MAGIC[8] = {'S', 'E', '4', 'H', 'P', 'C', 'T', 'L'};
+constexpr uint32_t VERSION = 1;
+constexpr int64_t HEADER_SIZE = 64;
+
+struct TiledHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t tile_rows;
+	uint32_t tile_cols;
+	uint32_t reserved0;
+	uint64_t rows;
+	uint64_t cols;
+	uint64_t reserved[3];
+};
+
+static_assert(sizeof(TiledHeader) == HEADER_SIZE, "the tiled file header is 64 bytes");
+
+
+// pread/pwrite may transfer less than asked, loop until done
+void
+read_all(const int fd, void *buffer, size_t size, int64_t offset, const std::string &path) {
+	char *p = static_cast<char *>(buffer);
+
+	while (size > 0) {
+		const ssize_t n = ::pread(fd, p, size, offset);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) throw std::runtime_error(path + ": read failed" + (n < 0 ? std::string(": ") + std::strerror(errno) : std::string(", file truncated")));
+
+		p += n;
+		size -= static_cast<size_t>(n);
+		offset += n;
+	}
+}
+
+
+void
+write_all(const int fd, const void *buffer, size_t size, int64_t offset, const std::string &path) {
+	const char *p = static_cast<const char *>(buffer);
+
+	while (size > 0) {
+		const ssize_t n = ::pwrite(fd, p, size, offset);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) throw std::runtime_error(path + ": write failed: " + std::strerror(errno));
+
+		p += n;
+		size -= static_cast<size_t>(n);
+		offset += n;
+	}
+}
+
+
+// Single background thread running the tile reads and writes in submission order, created once
+// per multiplication. Failures are delivered through the futures. On destruction the queued
+// jobs are still run before the thread is joined, so they must not outlive the buffers they use
+class IoWorker {
+public:
+	IoWorker() : m_thread(&IoWorker::run, this) {}
+
+	~IoWorker() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_one();
+		m_thread.join();
+	}
+
+	IoWorker(const IoWorker &) = delete;
+	IoWorker &operator=(const IoWorker &) = delete;
+
+	template <typename Job>
+	std::future<void> submit(Job job) {
+		std::packaged_task<void()> task(std::move(job));
+		std::future<void> done = task.get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back(std::move(task));
+		}
+		m_wake.notify_one();
+		return done;
+	}
+
+private:
+	void run() {
+		while (true) {
+			std::packaged_task<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+				if (m_jobs.empty()) return;
+
+				task = std::move(m_jobs.front());
+				m_jobs.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::deque<std::packaged_task<void()>> m_jobs;
+	bool m_stop = false;
+
+	// Last, started once the queue exists
+	std::thread m_thread;
+};
+
+}
+
+
+TiledMatrixFile::TiledMatrixFile(const std::string &path)
+	: m_path(path) {
+	m_fd = ::open(path.c_str(), O_RDONLY);
+	if (m_fd < 0) throw std::runtime_error(path + ": cannot open: " + std::strerror(errno));
+
+	TiledHeader h;
+
+	try {
+		read_all(m_fd, &h, sizeof(h), 0, path);
+	} catch (...) {
+		::close(m_fd);
+		throw;
+	}
+
+	if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION || h.tile_rows == 0 || h.tile_cols == 0 || h.rows > INT32_MAX || h.cols > INT32_MAX) {
+		::close(m_fd);
+		throw std::runtime_error(path + ": not a tiled matrix file");
+	}
+
+	m_rows = static_cast<int>(h.rows);
+	m_cols = static_cast<int>(h.cols);
+	m_tile_rows = static_cast<int>(h.tile_rows);
+	m_tile_cols = static_cast<int>(h.tile_cols);
+}
+
+
+TiledMatrixFile::TiledMatrixFile(const std::string &path, int rows, int cols, int tile_rows, int tile_cols)
+	: m_path(path), m_rows(rows), m_cols(cols), m_tile_rows(tile_rows), m_tile_cols(tile_cols) {
+	if (rows < 0 || cols < 0 || tile_rows <= 0 || tile_cols <= 0) throw std::runtime_error(path + ": invalid tiled matrix shape");
+
+	m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (m_fd < 0) throw std::runtime_error(path + ": cannot create: " + std::strerror(errno));
+
+	TiledHeader h = {};
+	std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+	h.version = VERSION;
+	h.tile_rows = static_cast<uint32_t>(tile_rows);
+	h.tile_cols = static_cast<uint32_t>(tile_cols);
+	h.rows = static_cast<uint64_t>(rows);
+	h.cols = static_cast<uint64_t>(cols);
+
+	try {
+		write_all(m_fd, &h, sizeof(h), 0, path);
+
+		// Sparse file of zero tiles, the real ones are written later in any order
+		if (::ftruncate(m_fd, tile_offset(tiles_down(), 0)) != 0) throw std::runtime_error(path + ": cannot size: " + std::strerror(errno));
+	} catch (...) {
+		::close(m_fd);
+		throw;
+	}
+}
+
+
+TiledMatrixFile::~TiledMatrixFile() {
+	if (m_fd >= 0) ::close(m_fd);
+}
+
+
+int64_t
+TiledMatrixFile::tile_offset(int ti, int tj) const {
+	const int64_t tile_bytes = static_cast<int64_t>(m_tile_rows) * m_tile_cols * sizeof(int);
+	return HEADER_SIZE + (static_cast<int64_t>(ti) * tiles_across() + tj) * tile_bytes;
+}
+
+
+void
+TiledMatrixFile::read_tile(int ti, int tj, int *tile) const {
+	read_all(m_fd, tile, static_cast<size_t>(m_tile_rows) * m_tile_cols * sizeof(int), tile_offset(ti, tj), m_path);
+}
+
+
+void
+TiledMatrixFile::write_tile(int ti, int tj, const int *tile) {
+	write_all(m_fd, tile, static_cast<size_t>(m_tile_rows) * m_tile_cols * sizeof(int), tile_offset(ti, tj), m_path);
+}
+
+
+void
+write_tiled_matrix(const std::string &path, const MatrixView<int> &M, int tile_rows, int tile_cols) {
+	TiledMatrixFile file(path, M.rows(), M.cols(), tile_rows, tile_cols);
+	std::vector<int> tile(static_cast<size_t>(tile_rows) * tile_cols);
+
+	for (int ti = 0; ti < file.tiles_down(); ++ti) {
+		for (int tj = 0; tj < file.tiles_across(); ++tj) {
+			std::fill(tile.begin(), tile.end(), 0);
+
+			const int i0 = ti * tile_rows, j0 = tj * tile_cols;
+			const int m = std::min(tile_rows, M.rows() - i0), n = std::min(tile_cols, M.cols() - j0);
+
+			for (int i = 0; i < m; ++i)
+				for (int j = 0; j < n; ++j) tile[i * tile_cols + j] = M(i0 + i, j0 + j);
+
+			file.write_tile(ti, tj, tile.data());
+		}
+	}
+}
+
+
+DenseMatrix
+read_tiled_matrix(const std::string &path) {
+	const TiledMatrixFile file(path);
+	DenseMatrix result(file.rows(), file.cols());
+	std::vector<int> tile(static_cast<size_t>(file.tile_rows()) * file.tile_cols());
+
+	for (int ti = 0; ti < file.tiles_down(); ++ti) {
+		for (int tj = 0; tj < file.tiles_across(); ++tj) {
+			file.read_tile(ti, tj, tile.data());
+
+			const int i0 = ti * file.tile_rows(), j0 = tj * file.tile_cols();
+			const int m = std::min(file.tile_rows(), file.rows() - i0), n = std::min(file.tile_cols(), file.cols() - j0);
+
+			for (int i = 0; i < m; ++i)
+				std::copy(tile.data() + i * file.tile_cols(), tile.data() + i * file.tile_cols() + n, result.row(i0 + i) + j0);
+		}
+	}
+
+	return result;
+}
+
+
+void
+multiplyMatricesOutOfCore(const std::string &pathA, const std::string &pathB, const std::string &pathC) {
+	const TiledMatrixFile A(pathA);
+	const TiledMatrixFile B(pathB);
+
+	if (A.cols() != B.rows() || A.tile_cols() != B.tile_rows()) throw std::runtime_error(pathA + " x " + pathB + ": incompatible shapes or tiles");
+
+	TiledMatrixFile C(pathC, A.rows(), B.cols(), A.tile_rows(), B.tile_cols());
+
+	const int tm = A.tile_rows(), tk = A.tile_cols(), tn = B.tile_cols();
+	const int tiles_k = A.tiles_across();
+
+	// Two slots of A/B tiles: one being multiplied, the other being read
+	struct Pair {
+		DenseMatrix a;
+		DenseMatrix b;
+	};
+
+	Pair slots[2] = {{DenseMatrix(tm, tk), DenseMatrix(tk, tn)}, {DenseMatrix(tm, tk), DenseMatrix(tk, tn)}};
+
+	DenseMatrix acc(tm, tn);
+	DenseMatrix finished(tm, tn);
+
+	// Steps are (ti, tj, tk) in order, the read of step s+1 overlaps the multiplication of step s
+	const long long steps = static_cast<long long>(C.tiles_down()) * C.tiles_across() * tiles_k;
+
+	auto read_step = [&](long long step, Pair &slot) {
+		const int k = static_cast<int>(step % tiles_k);
+		const long long ij = step / tiles_k;
+		const int ti = static_cast<int>(ij / C.tiles_across());
+		const int tj = static_cast<int>(ij % C.tiles_across());
+
+		A.read_tile(ti, k, slot.a.data());
+		B.read_tile(k, tj, slot.b.data());
+	};
+
+	// Declared after the buffers and read_step: its destructor finishes the jobs still using them,
+	// also when the loop below unwinds
+	IoWorker io;
+	std::future<void> pending_read;
+	std::future<void> pending_write;
+
+	if (steps > 0) pending_read = io.submit([&] { read_step(0, slots[0]); });
+
+	for (long long step = 0; step < steps; ++step) {
+		Pair &current = slots[step % 2];
+
+		pending_read.get();
+		if (step + 1 < steps) pending_read = io.submit([&read_step, &slots, step, steps] { read_step(step + 1, slots[(step + 1) % 2]); });
+
+		// The first term of a C tile overwrites the accumulator, the next ones add to it in place
+		const int k = static_cast<int>(step % tiles_k);
+		multiplyMatricesGemm(current.a, current.b, acc, 1, k == 0 ? 0 : 1);
+
+		if (k + 1 < tiles_k) continue;
+
+		// The C tile is complete: hand it to the writer and start a fresh accumulator
+		const long long ij = step / tiles_k;
+		const int ti = static_cast<int>(ij / C.tiles_across());
+		const int tj = static_cast<int>(ij % C.tiles_across());
+
+		if (pending_write.valid()) pending_write.get();
+		std::swap(finished, acc);
+		pending_write = io.submit([&C, &finished, ti, tj] { C.write_tile(ti, tj, finished.data()); });
+	}
+
+	if (pending_write.valid()) pending_write.get();
+}
@@ -0,0 +1,319 @@
+#include "sparse_matrix.h"
+#include "matrix_multiplication.h"
+#include "thread_pool.h"
+#include <algorithm>
+
+
+namespace {
+
+// Rows handed to one task of the pool
+constexpr int SPARSE_ROW_CHUNK = 64;
+
+
+template <typename Body>
+void
+for_each_row_chunk(const int rows, Body body) {
+	const int chunks = (rows + SPARSE_ROW_CHUNK - 1) / SPARSE_ROW_CHUNK;
+
+	default_thread_pool().parallel_for(chunks, [&](int chunk) {
+		const int first = chunk * SPARSE_ROW_CHUNK;
+		const int last = std::min(rows, first + SPARSE_ROW_CHUNK);
+
+		for (int i = first; i < last; ++i) body(i);
+	});
+}
+
+
+void
+prepare(DenseMatrix &C, const int rows, const int cols) {
+	if (C.rows() != rows || C.cols() != cols) C.resize(rows, cols);
+}
+
+
+// Generic compression of rows x cols entries given by get(i, j), row by row
+template <typename Get>
+CsrMatrix
+compress_rows(const int rows, const int cols, Get get) {
+	CsrMatrix result;
+	result.rows = rows;
+	result.cols = cols;
+	result.row_ptr.assign(rows + 1, 0);
+
+	for (int i = 0; i < rows; ++i) {
+		for (int j = 0; j < cols; ++j) {
+			const int value = get(i, j);
+			if (value == 0) continue;
+
+			result.col_idx.push_back(j);
+			result.values.push_back(value);
+		}
+		result.row_ptr[i + 1] = result.nnz();
+	}
+
+	return result;
+}
+
+
+// compress_rows only if at most max_density of the entries are non zero. The count stops at the
+// first row past the threshold, so a dense input costs a fraction of a pass
+template <typename Get>
+bool
+compress_rows_if_sparse(const int rows, const int cols, Get get, const double max_density, CsrMatrix &result) {
+	const double entries = static_cast<double>(rows) * cols;
+
+	long long nonzeros = 0;
+	for (int i = 0; i < rows; ++i) {
+		for (int j = 0; j < cols; ++j) nonzeros += get(i, j) != 0;
+		if (nonzeros / entries > max_density) return false;
+	}
+
+	result = compress_rows(rows, cols, get);
+	return true;
+}
+
+}
+
+
+long long
+count_nonzeros(const DenseMatrix &M) {
+	long long count = 0;
+
+	for (int i = 0; i < M.rows(); ++i) {
+		const int *row = M.row(i);
+		for (int j = 0; j < M.cols(); ++j) count += row[j] != 0;
+	}
+
+	return count;
+}
+
+
+double
+density(const DenseMatrix &M) {
+	if (M.empty()) return 0.0;
+
+	return static_cast<double>(count_nonzeros(M)) / (static_cast<double>(M.rows()) * M.cols());
+}
+
+
+CsrMatrix
+to_csr(const DenseMatrix &M) {
+	return compress_rows(M.rows(), M.cols(), [&](int i, int j) { return M(i, j); });
+}
+
+
+CsrMatrix
+to_csr(const std::vector<std::vector<int>> &M, int rows, int cols) {
+	return compress_rows(rows, cols, [&](int i, int j) { return M[i][j]; });
+}
+
+
+// Transposition of the compressed arrays: count per column, prefix sum, scatter
+CscMatrix
+to_csc(const CsrMatrix &M) {
+	CscMatrix result;
+	result.rows = M.rows;
+	result.cols = M.cols;
+	result.col_ptr.assign(M.cols + 1, 0);
+	result.row_idx.resize(M.nnz());
+	result.values.resize(M.nnz());
+
+	for (const int j : M.col_idx) ++result.col_ptr[j + 1];
+	for (int j = 0; j < M.cols; ++j) result.col_ptr[j + 1] += result.col_ptr[j];
+
+	std::vector<int> next(result.col_ptr.begin(), result.col_ptr.end() - 1);
+
+	// Rows are visited in order, so every column comes out sorted by row
+	for (int i = 0; i < M.rows; ++i) {
+		for (int e = M.row_ptr[i]; e < M.row_ptr[i + 1]; ++e) {
+			const int dst = next[M.col_idx[e]]++;
+			result.row_idx[dst] = i;
+			result.values[dst] = M.values[e];
+		}
+	}
+
+	return result;
+}
+
+
+CsrMatrix
+to_csr(const CscMatrix &M) {
+	// A CSC matrix is the CSR of the transpose, and vice versa
+	const CsrMatrix transposed{M.cols, M.rows, M.col_ptr, M.row_idx, M.values};
+	const CscMatrix back = to_csc(transposed);
+
+	return CsrMatrix{M.rows, M.cols, back.col_ptr, back.row_idx, back.values};
+}
+
+
+CscMatrix
+to_csc(const DenseMatrix &M) {
+	return to_csc(to_csr(M));
+}
+
+
+DenseMatrix
+to_dense(const CsrMatrix &M) {
+	DenseMatrix result(M.rows, M.cols);
+
+	for (int i = 0; i < M.rows; ++i)
+		for (int e = M.row_ptr[i]; e < M.row_ptr[i + 1]; ++e) result(i, M.col_idx[e]) = M.values[e];
+
+	return result;
+}
+
+
+DenseMatrix
+to_dense(const CscMatrix &M) {
+	return to_dense(to_csr(M));
+}
+
+
+bool
+to_csr_if_sparse(const DenseMatrix &M, CsrMatrix &result, double max_density) {
+	return compress_rows_if_sparse(M.rows(), M.cols(), [&](int i, int j) { return M(i, j); }, max_density, result);
+}
+
+
+bool
+to_csr_if_sparse(const std::vector<std::vector<int>> &M, int rows, int cols, CsrMatrix &result, double max_density) {
+	return compress_rows_if_sparse(rows, cols, [&](int i, int j) { return M[i][j]; }, max_density, result);
+}
+
+
+void
+multiplyMatricesSparse(const CsrMatrix &A, const DenseMatrix &B, DenseMatrix &C) {
+	prepare(C, A.rows, B.cols());
+
+	const int N = B.cols();
+
+	// Row i of C is a combination of the rows of B selected by the non zeros of row i of A
+	for_each_row_chunk(A.rows, [&](int i) {
+		int *c = C.row(i);
+		std::fill(c, c + N, 0);
+
+		for (int e = A.row_ptr[i]; e < A.row_ptr[i + 1]; ++e) {
+			const int a = A.values[e];
+			const int *b = B.row(A.col_idx[e]);
+			for (int j = 0; j < N; ++j) c[j] += a * b[j];
+		}
+	});
+}
+
+
+void
+multiplyMatricesSparse(const DenseMatrix &A, const CscMatrix &B, DenseMatrix &C) {
+	prepare(C, A.rows(), B.cols);
+
+	for_each_row_chunk(A.rows(), [&](int i) {
+		const int *a = A.row(i);
+		int *c = C.row(i);
+
+		for (int j = 0; j < B.cols; ++j) {
+			int sum = 0;
+			for (int e = B.col_ptr[j]; e < B.col_ptr[j + 1]; ++e) sum += a[B.row_idx[e]] * B.values[e];
+			c[j] = sum;
+		}
+	});
+}
+
+
+void
+multiplyMatricesSparse(const CsrMatrix &A, const CsrMatrix &B, CsrMatrix &C) {
+	const int rows = A.rows;
+	const int cols = B.cols;
+
+	// Gustavson row by row with a dense accumulator per thread. The rows are computed in
+	// parallel into separate buffers and concatenated at the end
+	std::vector<std::vector<int>> row_cols(rows);
+	std::vector<std::vector<int>> row_values(rows);
+
+	for_each_row_chunk(rows, [&](int i) {
+		thread_local std::vector<int> acc;
+		thread_local std::vector<char> used;
+		thread_local std::vector<int> touched;
+
+		// The accumulator is cleared through the touched list, never in full
+		if (static_cast<int>(acc.size()) < cols) {
+			acc.assign(cols, 0);
+			used.assign(cols, 0);
+		}
+		touched.clear();
+
+		for (int e = A.row_ptr[i]; e < A.row_ptr[i + 1]; ++e) {
+			const int a = A.values[e];
+			const int k = A.col_idx[e];
+
+			for (int f = B.row_ptr[k]; f < B.row_ptr[k + 1]; ++f) {
+				const int j = B.col_idx[f];
+				if (!used[j]) {
+					used[j] = 1;
+					touched.push_back(j);
+				}
+				acc[j] += a * B.values[f];
+			}
+		}
+
+		std::sort(touched.begin(), touched.end());
+
+		// NB: products can cancel out, only the true non zeros are kept
+		for (const int j : touched) {
+			if (acc[j] != 0) {
+				row_cols[i].push_back(j);
+				row_values[i].push_back(acc[j]);
+			}
+			acc[j] = 0;
+			used[j] = 0;
+		}
+	});
+
+	C.rows = rows;
+	C.cols = cols;
+	C.row_ptr.assign(rows + 1, 0);
+	C.col_idx.clear();
+	C.values.clear();
+
+	for (int i = 0; i < rows; ++i) {
+		C.col_idx.insert(C.col_idx.end(), row_cols[i].begin(), row_cols[i].end());
+		C.values.insert(C.values.end(), row_values[i].begin(), row_values[i].end());
+		C.row_ptr[i + 1] = C.nnz();
+	}
+}
+
+
+SparseChoice
+choose_sparse_kernel(const DenseMatrix &A, const DenseMatrix &B, double max_density) {
+	const bool sparseA = density(A) <= max_density;
+	const bool sparseB = density(B) <= max_density;
+
+	if (sparseA && sparseB) return SparseChoice::SparseBoth;
+	if (sparseA) return SparseChoice::SparseA;
+	if (sparseB) return SparseChoice::SparseB;
+
+	return SparseChoice::Dense;
+}
+
+
+void
+multiplyMatricesAuto(const DenseMatrix &A, const DenseMatrix &B, DenseMatrix &C, SparseChoice *chosen) {
+	const SparseChoice choice = choose_sparse_kernel(A, B);
+	if (chosen) *chosen = choice;
+
+	switch (choice) {
+	case SparseChoice::SparseBoth: {
+		CsrMatrix product;
+		multiplyMatricesSparse(to_csr(A), to_csr(B), product);
+		C = to_dense(product);
+		break;
+	}
+	case SparseChoice::SparseA:
+		multiplyMatricesSparse(to_csr(A), B, C);
+		break;
+	case SparseChoice::SparseB:
+		multiplyMatricesSparse(A, to_csc(B), C);
+		break;
+	case SparseChoice::Dense:
+	default:
+		multiplyMatricesParallel(A, B, C);
+		break;
+	}
+}
@@ -0,0 +1,200 @@
+#include "thread_pool.h"
+#include <cstdlib>
+
+
+namespace {
+
+// Set while a thread is executing a task of some pool, used to run nested loops serially
+thread_local bool inside_task = false;
+
+
+int
+resolve_thread_count(int threads) {
+	if (threads > 0) return threads;
+
+	if (const char *env = std::getenv("MATRIX_NUM_THREADS")) {
+		const int parsed = std::atoi(env);
+		if (parsed > 0) return parsed;
+	}
+
+	const int hw = static_cast<int>(std::thread::hardware_concurrency());
+	return hw > 0 ? hw : 1;
+}
+
+
+std::mutex default_pool_mutex;
+std::unique_ptr<ThreadPool> default_pool;
+
+}
+
+
+ThreadPool::ThreadPool(int threads)
+	: m_size(threads > 0 ? threads : 1) {
+	for (int i = 0; i < m_size; ++i) {
+		m_queues.push_back(std::make_unique<Queue>());
+	}
+
+	// Participant 0 is whoever calls parallel_for
+	for (int i = 1; i < m_size; ++i) {
+		m_workers.emplace_back(&ThreadPool::worker_loop, this, i);
+	}
+}
+
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (auto &worker : m_workers) {
+		worker.join();
+	}
+}
+
+
+void
+ThreadPool::parallel_for(int count, const std::function<void(int)> &task) {
+	if (count <= 0) return;
+
+	if (inside_task || m_size == 1 || count == 1) {
+		for (int i = 0; i < count; ++i) task(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> submit(m_submit);
+
+	// Deal contiguous chunks of indices, so neighbouring tiles start on the same thread
+	for (int id = 0; id < m_size; ++id) {
+		const int begin = static_cast<int>(static_cast<long long>(count) * id / m_size);
+		const int end = static_cast<int>(static_cast<long long>(count) * (id + 1) / m_size);
+
+		std::lock_guard<std::mutex> lock(m_queues[id]->mutex);
+		for (int i = begin; i < end; ++i) m_queues[id]->indices.push_back(i);
+	}
+
+	m_remaining.store(count);
+	m_failed.store(false);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = &task;
+		m_active = m_size - 1;
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	run_tasks(0);
+
+	// All the tasks are done once m_remaining hits zero, but the workers may still be looking
+	// at m_task: wait for every one of them to go back to sleep before returning
+	std::exception_ptr error;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this] { return m_active == 0; });
+		m_task = nullptr;
+		std::swap(error, m_error);
+	}
+
+	if (error) std::rethrow_exception(error);
+}
+
+
+void
+ThreadPool::worker_loop(int id) {
+	unsigned long seen = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+
+			if (m_stop) return;
+			seen = m_generation;
+		}
+
+		run_tasks(id);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_active;
+		}
+		m_done.notify_one();
+	}
+}
+
+
+void
+ThreadPool::run_tasks(int id) {
+	inside_task = true;
+
+	// After a failure the remaining indices are only drained, the caller rethrows the first error
+	int index;
+	while (m_remaining.load() > 0 && pop(id, index)) {
+		if (!m_failed.load()) {
+			try {
+				(*m_task)(index);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_error) m_error = std::current_exception();
+				m_failed.store(true);
+			}
+		}
+		m_remaining.fetch_sub(1);
+	}
+
+	inside_task = false;
+}
+
+
+bool
+ThreadPool::pop(int id, int &index) {
+	{
+		Queue &own = *m_queues[id];
+		std::lock_guard<std::mutex> lock(own.mutex);
+
+		if (!own.indices.empty()) {
+			index = own.indices.front();
+			own.indices.pop_front();
+			return true;
+		}
+	}
+
+	// Own queue is empty: steal from the back of the others, starting from the next participant
+	for (int offset = 1; offset < m_size; ++offset) {
+		Queue &victim = *m_queues[(id + offset) % m_size];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+
+		if (!victim.indices.empty()) {
+			index = victim.indices.back();
+			victim.indices.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+ThreadPool &
+default_thread_pool() {
+	std::lock_guard<std::mutex> lock(default_pool_mutex);
+
+	if (!default_pool) {
+		default_pool = std::make_unique<ThreadPool>(resolve_thread_count(0));
+	}
+
+	return *default_pool;
+}
+
+
+void
+set_default_thread_count(int threads) {
+	std::lock_guard<std::mutex> lock(default_pool_mutex);
+
+	const int resolved = resolve_thread_count(threads);
+	if (default_pool && default_pool->size() == resolved) return;
+
+	default_pool = std::make_unique<ThreadPool>(resolved);
+}
@@ -1,8 +1,24 @@
 #include "matrix_multiplication.h"
 #include "matrix_utils.h"
+#include "thread_pool.h"
+#include "simd_dispatch.h"
+#include "typed_multiplication.h"
+#include "batched_multiplication.h"
+#include "fixed_matrix.h"
+#include "matrix_io.h"
+#include "out_of_core.h"
+#include "sparse_matrix.h"
+#include "matrix_chain.h"
+#include "matrix_allocator.h"
+#include "matrix_instrumentation.h"
+#include "matrix_tuning.h"
+#include <cstdint>
 #include <iostream>
 #include <vector>
 #include <gtest/gtest.h>
+#include <climits>
+#include <sstream>
+#include <fstream>
 
 /*
 
@@ -290,6 +306,1405 @@ TEST(CorrectMatrixMutltiplicationTest, AssociativeMatMult){
 
 }
 
+TEST(CorrectMatrixMutltiplicationTest, DenseMatMult){
+
+    // The contiguous overload has to agree with the vector of vectors one on some random matrices
+
+    for(int seed=0;seed<4;++seed){
+
+        const int rowsA = 7 + seed;
+        const int colsA = 5 + 2*seed;
+        const int colsB = 3 + 3*seed;
+
+        Matrix A = build_random_matrix(rowsA,colsA,seed);
+        Matrix B = build_random_matrix(colsA,colsB,seed+1);
+        Matrix C = build_empty_matrix(rowsA,colsB);
+
+        multiplyMatricesWithoutErrors(A,B,C,rowsA,colsA,colsB);
+
+        DenseMatrix DA, DB, DC;
+        build_random_matrix(DA,rowsA,colsA,seed);
+        build_random_matrix(DB,colsA,colsB,seed+1);
+
+        // The two builders must produce the same numbers
+        ASSERT_EQ(DA.to_vectors(),A);
+        ASSERT_EQ(DB.to_vectors(),B);
+
+        // NB: DC is empty, the overload reshapes it
+        multiplyMatricesWithoutErrors(DA,DB,DC);
+
+        ASSERT_EQ(DC.rows(),rowsA);
+        ASSERT_EQ(DC.cols(),colsB);
+        ASSERT_EQ(DC.to_vectors(),C);
+
+    }
+
+    // A padded stride must not change the result
+    DenseMatrix A(2,3,8);
+    DenseMatrix B(3,2,4);
+    A(0,0)=1; A(0,1)=2; A(0,2)=3;
+    A(1,0)=4; A(1,1)=5; A(1,2)=6;
+    B(0,0)=1; B(1,0)=1; B(2,0)=1;
+    B(0,1)=1; B(1,1)=0; B(2,1)=-1;
+
+    DenseMatrix C;
+    multiplyMatricesWithoutErrors(A,B,C);
+
+    Matrix E = {
+
+        {6,-2},
+        {15,-2}
+
+    };
+
+    ASSERT_EQ(C.to_vectors(),E);
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, BlockedMatMult){
+
+    // The blocked kernel has to give exactly the same numbers as the reference one.
+    // The shapes are chosen to hit the edges of every block: smaller than a micro tile,
+    // not a multiple of the register block, and larger than the cache blocks (KC=256, MC=128)
+
+    const int shapes[][3] = {
+
+        {1,1,1},
+        {3,5,7},
+        {4,16,16},
+        {17,33,19},
+        {130,300,45},
+        {61,513,150}
+
+    };
+
+    for(const auto &shape : shapes){
+
+        DenseMatrix A, B, C, E;
+        build_random_matrix(A,shape[0],shape[1],shape[0]);
+        build_random_matrix(B,shape[1],shape[2],shape[2]);
+
+        multiplyMatricesWithoutErrors(A,B,E,MultiplyKernel::Reference);
+        multiplyMatricesWithoutErrors(A,B,C,MultiplyKernel::Blocked);
+
+        ASSERT_EQ(C,E) << "Blocked kernel differs for shape " << shape[0] << "x" << shape[1] << "x" << shape[2];
+
+    }
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, ParallelMatMult){
+
+    // The parallel kernel must not depend on the number of threads.
+    // More threads than cores is fine here, we only care about the tiling and the stealing
+
+    const int shapes[][3] = {
+
+        {1,1,1},
+        {5,3,9},
+        {37,70,41},
+        {300,129,533}
+
+    };
+
+    for(int threads : {1,2,3,7}){
+
+        ThreadPool pool(threads);
+
+        for(const auto &shape : shapes){
+
+            DenseMatrix A, B, C, E;
+            build_random_matrix(A,shape[0],shape[1],threads);
+            build_random_matrix(B,shape[1],shape[2],threads+1);
+
+            multiplyMatricesWithoutErrors(A,B,E);
+
+            // The pool is reused for repeated calls
+            for(int repeat=0;repeat<3;++repeat){
+
+                multiplyMatricesParallel(A,B,C,pool);
+                ASSERT_EQ(C,E) << threads << " threads, shape " << shape[0] << "x" << shape[1] << "x" << shape[2];
+
+            }
+
+        }
+
+    }
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, ThreadPoolRunsEveryIndexOnce){
+
+    // Every index must be executed exactly once, also when the count does not divide the threads
+
+    ThreadPool pool(4);
+
+    for(int count : {1,3,4,5,97}){
+
+        std::vector<std::atomic<int>> hits(count);
+        for(auto &h : hits) h = 0;
+
+        pool.parallel_for(count,[&](int i){ ++hits[i]; });
+
+        for(int i=0;i<count;++i) ASSERT_EQ(hits[i].load(),1);
+
+    }
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, ThreadPoolRethrowsTaskErrors){
+
+    // The first exception of a task reaches the caller, whichever thread ran it, and the pool
+    // keeps working afterwards
+
+    ThreadPool pool(4);
+
+    for(int failing : {0,50,99}){
+        std::atomic<int> done(0);
+        ASSERT_THROW(pool.parallel_for(100,[&](int i){
+            if(i==failing) throw std::runtime_error("task");
+            ++done;
+        }),std::runtime_error);
+        ASSERT_LT(done.load(),100);
+
+        std::vector<std::atomic<int>> hits(100);
+        for(auto &h : hits) h = 0;
+        pool.parallel_for(100,[&](int i){ ++hits[i]; });
+        for(int i=0;i<100;++i) ASSERT_EQ(hits[i].load(),1);
+    }
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, SimdMicroKernels){
+
+    // Every micro-kernel the CPU supports must give bit-identical results to the scalar one
+
+    const SimdLevel detected = detected_simd_level();
+
+    DenseMatrix A, B, E;
+    build_random_matrix(A,45,300,1);
+    build_random_matrix(B,300,70,2);
+
+    set_simd_level(SimdLevel::Scalar);
+    ASSERT_EQ(active_simd_level(),SimdLevel::Scalar);
+    multiplyMatricesBlocked(A,B,E);
+
+    for(SimdLevel level : {SimdLevel::SSE41,SimdLevel::AVX2,SimdLevel::AVX512}){
+
+        if(static_cast<int>(level) > static_cast<int>(detected)) continue;
+
+        DenseMatrix C;
+        set_simd_level(level);
+        ASSERT_EQ(active_simd_level(),level);
+        multiplyMatricesBlocked(A,B,C);
+
+        ASSERT_EQ(C,E) << "Micro-kernel " << simd_level_name(level) << " differs from the scalar one";
+
+    }
+
+    set_simd_level(detected);
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, StrassenMatMult){
+
+    // Strassen-Winograd has to be exactly equal to the reference kernel.
+    // Tiny cutoffs force several levels of recursion, and the odd sizes force the peeling
+    // of the last row/column/term at different levels
+
+    const int shapes[][3] = {
+
+        {2,2,2},
+        {3,3,3},
+        {8,8,8},
+        {17,17,17},
+        {33,31,29},
+        {64,65,66},
+        {100,7,100}
+
+    };
+
+    for(int cutoff : {1,2,5,16}){
+
+        for(const auto &shape : shapes){
+
+            DenseMatrix A, B, C, E;
+            build_random_matrix(A,shape[0],shape[1],cutoff);
+            build_random_matrix(B,shape[1],shape[2],cutoff+1);
+
+            multiplyMatricesWithoutErrors(A,B,E);
+            multiplyMatricesStrassen(A,B,C,cutoff);
+
+            ASSERT_EQ(C,E) << "cutoff " << cutoff << ", shape " << shape[0] << "x" << shape[1] << "x" << shape[2];
+
+        }
+
+    }
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, StrassenAssociativeMatMult){
+
+    // Same idea of AssociativeMatMult: (A*B)*C=A*(B*C), computed with Strassen at every
+    // step and compared with the reference kernel. The entries are kept small so that
+    // the product of three matrices stays far from overflowing
+
+    DenseMatrix A, B, C;
+    build_random_matrix(A,45,38,1);
+    build_random_matrix(B,38,51,2);
+    build_random_matrix(C,51,27,3);
+
+    for(DenseMatrix *M : {&A,&B,&C})
+        for(int i=0;i<M->rows();++i)
+            for(int j=0;j<M->cols();++j) (*M)(i,j) %= 50;
+
+    DenseMatrix T, D, E;
+
+    // Reference: (A*B)*C
+    multiplyMatricesWithoutErrors(A,B,T);
+    multiplyMatricesWithoutErrors(T,C,E);
+
+    // (A*B)*C
+    multiplyMatricesStrassen(A,B,T,4);
+    multiplyMatricesStrassen(T,C,D,4);
+    ASSERT_EQ(D,E);
+
+    // A*(B*C)
+    multiplyMatricesStrassen(B,C,T,4);
+    multiplyMatricesStrassen(A,T,D,4);
+    ASSERT_EQ(D,E);
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, CheckedMatMult){
+
+    // Without overflow the checked kernel is just another exact kernel
+
+    DenseMatrix A, B, C, E;
+    build_random_matrix(A,70,20,1);
+    build_random_matrix(B,20,300,2);
+
+    multiplyMatricesWithoutErrors(A,B,E);
+
+    std::vector<OverflowTile> overflows;
+    ASSERT_TRUE(multiplyMatricesChecked(A,B,C,OverflowPolicy::Saturate,&overflows));
+    ASSERT_TRUE(overflows.empty());
+    ASSERT_EQ(C,E);
+
+    BasicDenseMatrix<long long> W;
+    multiplyMatricesWide(A,B,W);
+    for(int i=0;i<E.rows();++i)
+        for(int j=0;j<E.cols();++j) ASSERT_EQ(W(i,j),E(i,j));
+
+    // Now two entries are pushed out of range: C(40,260) past INT_MAX and C(3,5) past INT_MIN,
+    // the other entries stay zero. 3 * 46341^2 does not fit in an int, while it does fit in an int64
+
+    A.fill(0);
+    B.fill(0);
+    for(int k=0;k<3;++k){ A(40,k)=46341; B(k,260)=46341; }
+    A(3,10)=-46341; B(10,5)=46341;
+    A(3,11)=-46341; B(11,5)=46341;
+
+    const long long big = 3LL*46341*46341;
+    const long long small = -2LL*46341*46341;
+
+    multiplyMatricesWide(A,B,W);
+    ASSERT_EQ(W(40,260),big);
+    ASSERT_EQ(W(3,5),small);
+
+    overflows.clear();
+    ASSERT_FALSE(multiplyMatricesChecked(A,B,C,OverflowPolicy::Saturate,&overflows));
+    ASSERT_EQ(C(40,260),INT_MAX);
+    ASSERT_EQ(C(3,5),INT_MIN);
+    ASSERT_EQ(C(40,259),0);
+
+    // Two different tiles are reported, each one containing its overflowing entry
+    ASSERT_EQ(overflows.size(),2u);
+    for(const auto &pos : {std::make_pair(40,260),std::make_pair(3,5)}){
+
+        bool found = false;
+        for(const auto &t : overflows)
+            found |= pos.first>=t.row && pos.first<t.row+t.rows && pos.second>=t.col && pos.second<t.col+t.cols;
+
+        ASSERT_TRUE(found);
+
+    }
+
+    // Wrap keeps the low 32 bits
+    ASSERT_FALSE(multiplyMatricesChecked(A,B,C,OverflowPolicy::Wrap));
+    ASSERT_EQ(C(40,260),static_cast<int>(static_cast<unsigned int>(big)));
+
+    // The same modes through the entry point
+    DenseMatrix D;
+    BasicDenseMatrix<long long> V;
+    ASSERT_FALSE(multiplyMatricesWithoutErrors(A,B,D,OverflowPolicy::Saturate));
+    ASSERT_EQ(D(40,260),INT_MAX);
+    multiplyMatricesWithoutErrors(A,B,V);
+    ASSERT_EQ(V,W);
+
+}
+
+// The same checks for every element type: the dispatched kernel (fast path if there is one)
+// against a naive i-j-k product written here, accumulating in the same type
+template <typename T>
+class TypedMatrixMutltiplicationTest : public testing::Test {};
+
+using ElementTypes = testing::Types<int8_t,int16_t,int,long long,float,double>;
+TYPED_TEST_SUITE(TypedMatrixMutltiplicationTest, ElementTypes);
+
+TYPED_TEST(TypedMatrixMutltiplicationTest, TypedMatMult){
+
+    using T = TypeParam;
+    using Acc = accumulator_t<T>;
+
+    // Odd sizes on purpose: odd K leaves half a pair for the packed int16 kernels,
+    // and N crosses the 32/64 column blocks of the SIMD paths
+    const int shapes[][3] = {
+
+        {1,1,1},
+        {3,5,7},
+        {9,64,65},
+        {20,101,130}
+
+    };
+
+    for(const auto &shape : shapes){
+
+        BasicDenseMatrix<T> A, B;
+        build_random_matrix(A,shape[0],shape[1],1);
+        build_random_matrix(B,shape[1],shape[2],2);
+
+        ASSERT_EQ(A.rows(),shape[0]);
+        ASSERT_EQ(A.cols(),shape[1]);
+
+        BasicDenseMatrix<Acc> C, E(shape[0],shape[2]);
+
+        for(int i=0;i<shape[0];++i)
+            for(int j=0;j<shape[2];++j){
+                // Integers wrap around, as in every kernel
+                using Sum = wrapping_sum_t<Acc>;
+                Sum sum = 0;
+                for(int k=0;k<shape[1];++k) sum += static_cast<Sum>(static_cast<Acc>(A(i,k)))*static_cast<Sum>(static_cast<Acc>(B(k,j)));
+                E(i,j) = static_cast<Acc>(sum);
+            }
+
+        multiplyMatricesTyped(A,B,C);
+
+        ASSERT_EQ(C.rows(),E.rows());
+        ASSERT_EQ(C.cols(),E.cols());
+
+        for(int i=0;i<shape[0];++i)
+            for(int j=0;j<shape[2];++j){
+                if constexpr (std::is_floating_point<T>::value){
+                    // FMA rounds once per term instead of twice
+                    ASSERT_NEAR(C(i,j),E(i,j),1e-4*shape[1]);
+                } else {
+                    ASSERT_EQ(C(i,j),E(i,j)) << "at " << i << "," << j;
+                }
+            }
+
+        // The portable kernel is exact for the integers as well
+        if constexpr (std::is_integral<T>::value){
+            BasicDenseMatrix<Acc> G;
+            multiplyMatricesGeneric(A,B,G);
+            ASSERT_EQ(G,E);
+        }
+
+    }
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, NarrowMatMultLevels){
+
+    // int8 inputs with int32 accumulation: every SIMD level must match the portable kernel,
+    // extreme int8 values included
+
+    BasicDenseMatrix<int8_t> A(13,77), B(77,70);
+    for(int i=0;i<A.rows();++i) for(int j=0;j<A.cols();++j) A(i,j) = static_cast<int8_t>((i*31+j*17)%256-128);
+    for(int i=0;i<B.rows();++i) for(int j=0;j<B.cols();++j) B(i,j) = static_cast<int8_t>((i*7+j*13)%256-128);
+
+    BasicDenseMatrix<int32_t> E;
+    multiplyMatricesGeneric(A,B,E);
+
+    const SimdLevel detected = detected_simd_level();
+
+    for(SimdLevel level : {SimdLevel::Scalar,SimdLevel::SSE41,SimdLevel::AVX2,SimdLevel::AVX512}){
+
+        if(static_cast<int>(level) > static_cast<int>(detected)) continue;
+
+        set_simd_level(level);
+        BasicDenseMatrix<int32_t> C;
+        multiplyMatricesNarrow(A,B,C);
+        ASSERT_EQ(C,E) << simd_level_name(level);
+
+    }
+
+    // int16 at -32768 overflows int32 after two terms: every level wraps around like the portable kernel
+    BasicDenseMatrix<int16_t> A16(3,5), B16(5,17);
+    for(int i=0;i<A16.rows();++i) for(int j=0;j<A16.cols();++j) A16(i,j) = INT16_MIN;
+    for(int i=0;i<B16.rows();++i) for(int j=0;j<B16.cols();++j) B16(i,j) = INT16_MIN;
+
+    BasicDenseMatrix<int32_t> E16;
+    multiplyMatricesGeneric(A16,B16,E16);
+    ASSERT_EQ(E16(0,0),static_cast<int32_t>(5u<<30));
+
+    for(SimdLevel level : {SimdLevel::Scalar,SimdLevel::SSE41,SimdLevel::AVX2,SimdLevel::AVX512}){
+
+        if(static_cast<int>(level) > static_cast<int>(detected)) continue;
+
+        set_simd_level(level);
+        BasicDenseMatrix<int32_t> C;
+        multiplyMatricesNarrow(A16,B16,C);
+        ASSERT_EQ(C,E16) << simd_level_name(level);
+
+    }
+
+    set_simd_level(detected);
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, BatchedMatMult){
+
+    // Batches of the tiny sizes of IdentityMatMult and DegenerateMatMult, and some larger ones.
+    // The batch counts are not multiples of the interleaving width nor of the chunk size
+
+    const int shapes[][3] = {
+
+        {1,1,1},
+        {2,2,2},
+        {4,4,4},
+        {3,8,5},
+        {8,8,8},
+        {9,4,4},
+        {32,32,32}
+
+    };
+
+    for(const auto &shape : shapes){
+
+        const int M = shape[0], K = shape[1], N = shape[2];
+
+        for(int batch : {1,15,17,300}){
+
+            std::vector<DenseMatrix> A(batch), B(batch), C, E(batch);
+            for(int b=0;b<batch;++b){
+                build_random_matrix(A[b],M,K,2*b);
+                build_random_matrix(B[b],K,N,2*b+1);
+                multiplyMatricesWithoutErrors(A[b],B[b],E[b]);
+            }
+
+            multiplyMatricesBatched(A,B,C);
+
+            ASSERT_EQ(C.size(),E.size());
+            for(int b=0;b<batch;++b) ASSERT_EQ(C[b],E[b]) << "matrix " << b << " of " << batch << ", shape " << M << "x" << K << "x" << N;
+
+            // Strided version on one contiguous buffer per operand
+            std::vector<int> a(batch*M*K), bb(batch*K*N), c(batch*M*N, -1);
+            for(int b=0;b<batch;++b)
+                for(int i=0;i<M;++i) for(int k=0;k<K;++k) a[b*M*K+i*K+k] = A[b](i,k);
+            for(int b=0;b<batch;++b)
+                for(int k=0;k<K;++k) for(int j=0;j<N;++j) bb[b*K*N+k*N+j] = B[b](k,j);
+
+            multiplyMatricesBatched(batch,M,N,K,a.data(),K,M*K,bb.data(),N,K*N,c.data(),N,M*N);
+
+            for(int b=0;b<batch;++b)
+                for(int i=0;i<M;++i) for(int j=0;j<N;++j) ASSERT_EQ(c[b*M*N+i*N+j],E[b](i,j));
+
+            // Array of pointers version, writing into fresh matrices
+            std::vector<DenseMatrix> D(batch,DenseMatrix(M,N));
+            std::vector<const int*> pa(batch), pb(batch);
+            std::vector<int*> pd(batch);
+            for(int b=0;b<batch;++b){ pa[b]=A[b].data(); pb[b]=B[b].data(); pd[b]=D[b].data(); }
+
+            multiplyMatricesBatched(batch,M,N,K,pa.data(),K,pb.data(),N,pd.data(),N);
+
+            for(int b=0;b<batch;++b) ASSERT_EQ(D[b],E[b]);
+
+        }
+
+    }
+
+    // Mismatched batches are rejected instead of read past the end
+    std::vector<DenseMatrix> A(3,DenseMatrix(2,2)), B(2,DenseMatrix(2,2)), C;
+    ASSERT_THROW(multiplyMatricesBatched(A,B,C),std::invalid_argument);
+    B.assign(3,DenseMatrix(3,2));
+    ASSERT_THROW(multiplyMatricesBatched(A,B,C),std::invalid_argument);
+
+}
+
+// The fixed size product is evaluated by the compiler: if these fail the file does not build
+constexpr FixedMatrix<int,2,2> FIXED_A = {{1,2},{3,4}};
+constexpr FixedMatrix<int,2,1> FIXED_B = {{2},{3}};
+static_assert((FIXED_A*FIXED_A) == FixedMatrix<int,2,2>({{7,10},{15,22}}), "constexpr 2x2 product");
+static_assert((FIXED_A*FIXED_B)(1,0) == 18, "constexpr matrix-vector product");
+
+template <int R, int K, int C>
+void checkFixedAgainstReference(int seed){
+
+    Matrix A = build_random_matrix(R,K,seed);
+    Matrix B = build_random_matrix(K,C,seed+1);
+    Matrix E = build_empty_matrix(R,C);
+
+    multiplyMatricesWithoutErrors(A,B,E,R,K,C);
+
+    const FixedMatrix<int,R,K> FA(A);
+    const FixedMatrix<int,K,C> FB(B);
+    FixedMatrix<int,R,C> FC;
+
+    multiplyMatricesWithoutErrors(FA,FB,FC);
+
+    ASSERT_EQ(FC.to_vectors(),E) << R << "x" << K << "x" << C;
+    ASSERT_EQ(FA*FB,FC);
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, FixedMatMult){
+
+    // The sizes used all over the test files, plus a few rectangular ones
+
+    for(int seed=0;seed<5;++seed){
+
+        checkFixedAgainstReference<1,1,1>(seed);
+        checkFixedAgainstReference<2,2,2>(seed);
+        checkFixedAgainstReference<3,3,3>(seed);
+        checkFixedAgainstReference<4,4,4>(seed);
+        checkFixedAgainstReference<2,3,4>(seed);
+        checkFixedAgainstReference<1,6,1>(seed);
+        checkFixedAgainstReference<6,1,6>(seed);
+
+    }
+
+    // Round trip through the Matrix alias
+    Matrix M = {
+
+        {1,2,3},
+        {4,5,6}
+
+    };
+
+    ASSERT_EQ((FixedMatrix<int,2,3>(M).to_vectors()),M);
+
+    // Initializer lists larger than the matrix are rejected, shorter ones are zero filled
+    using Fixed22 = FixedMatrix<int,2,2>;
+    ASSERT_THROW((Fixed22{{1,2},{3,4},{5,6}}),std::invalid_argument);
+    ASSERT_THROW((Fixed22{{1,2,3},{4,5}}),std::invalid_argument);
+    ASSERT_EQ((Fixed22{{1},{2,3}}),(Fixed22{{1,0},{2,3}}));
+
+    // Same associativity of AssociativeMatMult, without any allocation
+    const FixedMatrix<int,2,2> A = {{1,2},{3,4}};
+    const FixedMatrix<int,2,1> B = {{2},{3}};
+    const FixedMatrix<int,1,2> C = {{1,4}};
+    const FixedMatrix<int,2,2> E = {{8,32},{18,72}};
+
+    ASSERT_EQ((A*B)*C,E);
+    ASSERT_EQ(A*(B*C),E);
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, CounterBasedRandomMatrix){
+
+    // Element (i,j) only depends on (seed,i,j): the matrix must not change with the number of
+    // threads, and any element (or tile) can be regenerated on its own
+
+    const int rows = 300, cols = 400;
+
+    DenseMatrix serial, parallel;
+
+    set_default_thread_count(1);
+    build_random_matrix(serial,rows,cols,7);
+
+    set_default_thread_count(5);
+    build_random_matrix(parallel,rows,cols,7);
+
+    set_default_thread_count(0);
+
+    ASSERT_EQ(serial,parallel);
+
+    for(int i=100;i<110;++i)
+        for(int j=250;j<260;++j) ASSERT_EQ(serial(i,j),random_matrix_element(7,i,j,-10000,10000));
+
+    // The same element does not depend on the shape of the matrix either
+    DenseMatrix small;
+    build_random_matrix(small,3,3,7);
+    ASSERT_EQ(small(2,1),serial(2,1));
+
+    // Another seed gives another matrix
+    DenseMatrix other;
+    build_random_matrix(other,rows,cols,8);
+    ASSERT_NE(serial,other);
+
+    // The default range is kept, and the full int range is reachable (the old @TODO)
+    DenseMatrix full;
+    build_random_matrix(full,rows,cols,7,INT_MIN,INT_MAX);
+
+    long long lo = 0, hi = 0;
+    for(int i=0;i<rows;++i)
+        for(int j=0;j<cols;++j){
+            ASSERT_GE(serial(i,j),-10000);
+            ASSERT_LE(serial(i,j),10000);
+            lo = std::min<long long>(lo,full(i,j));
+            hi = std::max<long long>(hi,full(i,j));
+        }
+
+    ASSERT_LT(lo,-2000000000LL);
+    ASSERT_GT(hi,2000000000LL);
+
+    // The full int64 range, whose span does not fit in 64 bits
+    BasicDenseMatrix<long long> wide;
+    build_random_matrix<long long>(wide,rows,cols,7,LLONG_MIN,LLONG_MAX);
+
+    int negative = 0, positive = 0;
+    for(int i=0;i<rows;++i)
+        for(int j=0;j<cols;++j){
+            ASSERT_NE(wide(i,j),LLONG_MIN);
+            negative += wide(i,j) < -(1LL<<62);
+            positive += wide(i,j) > (1LL<<62);
+        }
+    ASSERT_GT(negative,0);
+    ASSERT_GT(positive,0);
+    ASSERT_EQ(random_matrix_element<long long>(7,3,4,LLONG_MIN,LLONG_MAX),wide(3,4));
+
+    // A narrow range is respected exactly, both ends included
+    DenseMatrix dice;
+    build_random_matrix(dice,50,50,1,1,6);
+
+    int counts[7] = {};
+    for(int i=0;i<50;++i)
+        for(int j=0;j<50;++j){
+            ASSERT_GE(dice(i,j),1);
+            ASSERT_LE(dice(i,j),6);
+            ++counts[dice(i,j)];
+        }
+
+    for(int face=1;face<=6;++face) ASSERT_GT(counts[face],0);
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, MappedMatrixFiles){
+
+    // Round trip through the binary format, and multiplication straight from the mapped pages
+
+    const std::string pathA = testing::TempDir() + "se4hpc_A.mat";
+    const std::string pathB = testing::TempDir() + "se4hpc_B.mat";
+
+    DenseMatrix A, B, E;
+    build_random_matrix(A,37,53,1);
+    build_random_matrix(B,53,29,2);
+    multiplyMatricesWithoutErrors(A,B,E);
+
+    save_matrix(pathA,A);
+
+    // B is streamed column by column, so the file is column-major
+    {
+        MatrixFileWriter writer(pathB,MatrixDType::Int32,B.rows(),B.cols(),MatrixLayout::ColMajor);
+        std::vector<int> column(B.rows());
+        for(int j=0;j<B.cols();++j){
+            for(int i=0;i<B.rows();++i) column[i]=B(i,j);
+            writer.write_line(column.data());
+        }
+        writer.close();
+    }
+
+    MappedMatrixFile fileA(pathA);
+    MappedMatrixFile fileB(pathB);
+
+    ASSERT_EQ(fileA.rows(),37);
+    ASSERT_EQ(fileA.cols(),53);
+    ASSERT_EQ(fileA.dtype(),MatrixDType::Int32);
+
+    const MatrixView<int> viewA = fileA.view<int>();
+    const MatrixView<int> viewB = fileB.view<int>();
+
+    // The payload is aligned and the row-major view points into the mapping
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(viewA.data())%64,0u);
+    ASSERT_TRUE(viewA.is_row_major());
+    ASSERT_FALSE(viewB.is_row_major());
+
+    ASSERT_EQ(viewA.to_dense(),A);
+    ASSERT_EQ(viewB.to_dense(),B);
+    ASSERT_EQ(viewB.transposed()(3,7),B(7,3));
+
+    DenseMatrix C;
+    multiplyMatricesWithoutErrors(viewA,viewB,C);
+    ASSERT_EQ(C,E);
+
+    // Wrong dtype and broken files are rejected
+    ASSERT_THROW(fileA.view<float>(),std::runtime_error);
+    ASSERT_THROW(MappedMatrixFile(testing::TempDir()+"se4hpc_missing.mat"),std::runtime_error);
+
+    {
+        std::ofstream truncated(pathB,std::ios::binary|std::ios::trunc);
+        truncated.write(reinterpret_cast<const char*>(&fileA.header()),sizeof(MatrixFileHeader));
+    }
+    ASSERT_THROW(MappedMatrixFile{pathB},std::runtime_error);
+
+    // Crafted headers: strides whose extent wraps around 2^64, the other byte order
+    auto rejects = [&](MatrixFileHeader h, const char *reason){
+        {
+            std::ofstream out(pathB,std::ios::binary|std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&h),sizeof(h));
+            out.write(std::string(4096,'\0').data(),4096);
+        }
+        try{
+            MappedMatrixFile file(pathB);
+            FAIL() << reason;
+        }catch(const std::runtime_error &){}
+    };
+    MatrixFileHeader crafted = fileA.header();
+    crafted.rows = 3;
+    crafted.cols = 2;
+    crafted.row_stride = 1ULL<<62;
+    crafted.col_stride = 1;
+    rejects(crafted,"row stride overflow");
+    crafted.row_stride = 100;
+    crafted.element_size = 4;
+    crafted.payload_offset = UINT64_MAX-63;
+    rejects(crafted,"payload offset overflow");
+    crafted = fileA.header();
+    crafted.version = 1u<<24;
+    rejects(crafted,"byte order");
+    crafted = fileA.header();
+    crafted.layout = 2;
+    rejects(crafted,"layout");
+
+    // The writer refuses an incomplete matrix
+    MatrixFileWriter incomplete(pathB,MatrixDType::Int32,2,2);
+    incomplete.write_line(A.row(0));
+    ASSERT_THROW(incomplete.close(),std::runtime_error);
+
+    std::remove(pathA.c_str());
+    std::remove(pathB.c_str());
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, OutOfCoreMatMult){
+
+    // Tiny tiles so that many tiles (edges included) go through the double buffering
+
+    const std::string pathA = testing::TempDir() + "se4hpc_tiled_A.mat";
+    const std::string pathB = testing::TempDir() + "se4hpc_tiled_B.mat";
+    const std::string pathC = testing::TempDir() + "se4hpc_tiled_C.mat";
+
+    DenseMatrix A, B, E;
+    build_random_matrix(A,53,70,1);
+    build_random_matrix(B,70,45,2);
+    multiplyMatricesWithoutErrors(A,B,E);
+
+    write_tiled_matrix(pathA,A,16,24);
+    write_tiled_matrix(pathB,B,24,10);
+
+    // Round trip first
+    ASSERT_EQ(read_tiled_matrix(pathA),A);
+    ASSERT_EQ(read_tiled_matrix(pathB),B);
+
+    multiplyMatricesOutOfCore(pathA,pathB,pathC);
+
+    const TiledMatrixFile C(pathC);
+    ASSERT_EQ(C.tile_rows(),16);
+    ASSERT_EQ(C.tile_cols(),10);
+    ASSERT_EQ(read_tiled_matrix(pathC),E);
+
+    // The tile grids of A and B have to agree
+    write_tiled_matrix(pathB,B,20,10);
+    ASSERT_THROW(multiplyMatricesOutOfCore(pathA,pathB,pathC),std::runtime_error);
+
+    std::remove(pathA.c_str());
+    std::remove(pathB.c_str());
+    std::remove(pathC.c_str());
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, SparseMatMult){
+
+    // Identity, permutation and banded matrices as in IdentityMatMult, against the dense kernel
+
+    const int n = 150;
+
+    DenseMatrix I(n,n), P(n,n), Band(n,n), D;
+    for(int i=0;i<n;++i){
+        I(i,i) = 1;
+        P(i,(7*i+3)%n) = 2;         // 7 and 150 are coprime: a permutation
+        for(int j=std::max(0,i-2);j<=std::min(n-1,i+2);++j) Band(i,j) = i-j+3;
+    }
+    build_random_matrix(D,n,n,1);
+
+    // Conversions keep every entry, and CSR <-> CSC are each other's transpose
+    for(const DenseMatrix *M : {&I,&P,&Band,&D}){
+        ASSERT_EQ(to_dense(to_csr(*M)),*M);
+        ASSERT_EQ(to_dense(to_csc(*M)),*M);
+        ASSERT_EQ(to_dense(to_csr(to_csc(*M))),*M);
+        ASSERT_EQ(to_csr(*M).nnz(),count_nonzeros(*M));
+    }
+
+    ASSERT_EQ(to_csr(Band.to_vectors(),n,n).values,to_csr(Band).values);
+
+    for(const DenseMatrix *S : {&I,&P,&Band}){
+
+        DenseMatrix E, C;
+        multiplyMatricesWithoutErrors(*S,D,E);
+
+        // SpMM
+        multiplyMatricesSparse(to_csr(*S),D,C);
+        ASSERT_EQ(C,E);
+
+        // Dense x sparse
+        multiplyMatricesWithoutErrors(D,*S,E);
+        multiplyMatricesSparse(D,to_csc(*S),C);
+        ASSERT_EQ(C,E);
+
+        // SpGEMM
+        multiplyMatricesWithoutErrors(*S,Band,E);
+        CsrMatrix S2;
+        multiplyMatricesSparse(to_csr(*S),to_csr(Band),S2);
+        ASSERT_EQ(to_dense(S2),E);
+        ASSERT_EQ(S2.nnz(),count_nonzeros(E));
+
+    }
+
+    // Cancellation: (1 1) * (1 -1)^T has no non zero at all
+    CsrMatrix zero;
+    multiplyMatricesSparse(to_csr(Matrix{{1,1}},1,2),to_csr(Matrix{{1},{-1}},2,1),zero);
+    ASSERT_EQ(zero.nnz(),0);
+
+    // The density threshold
+    CsrMatrix converted;
+    ASSERT_TRUE(to_csr_if_sparse(I,converted));
+    ASSERT_FALSE(to_csr_if_sparse(D,converted));
+    ASSERT_TRUE(to_csr_if_sparse(P.to_vectors(),n,n,converted));
+    ASSERT_EQ(to_dense(converted),P);
+    ASSERT_FALSE(to_csr_if_sparse(D.to_vectors(),n,n,converted));
+    ASSERT_TRUE(to_csr_if_sparse(D.to_vectors(),n,n,converted,1.0));
+    ASSERT_EQ(to_dense(converted),D);
+
+    // The automatic selection looks at both operands and always gives the dense result
+    const std::pair<const DenseMatrix*,const DenseMatrix*> cases[] = {{&D,&D},{&P,&D},{&D,&Band},{&I,&P}};
+    const SparseChoice expected[] = {SparseChoice::Dense,SparseChoice::SparseA,SparseChoice::SparseB,SparseChoice::SparseBoth};
+
+    for(int c=0;c<4;++c){
+        DenseMatrix E, C;
+        SparseChoice chosen;
+        multiplyMatricesWithoutErrors(*cases[c].first,*cases[c].second,E);
+        multiplyMatricesAuto(*cases[c].first,*cases[c].second,C,&chosen);
+        ASSERT_EQ(chosen,expected[c]);
+        ASSERT_EQ(C,E);
+    }
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, ChainMatMult){
+
+    // The textbook instance (Cormen et al., 15.2): 15125 scalar multiplications, 2 operations each
+
+    const ChainPlan plan = plan_matrix_chain({30,35,15,5,10,20,25});
+    ASSERT_EQ(plan.cost,2.0*15125);
+    ASSERT_EQ(plan.to_string(),"((M0 (M1 M2)) ((M3 M4) M5))");
+
+    // AssociativeMatMult through the planner: A*B*C has to be computed as (A*B)*C
+    DenseMatrix A(Matrix{{1,2},{3,4}}), B(Matrix{{2},{3}}), C(Matrix{{1,4}}), E(Matrix{{8,32},{18,72}}), R;
+    ChainPlan used;
+    multiplyChain({&A,&B,&C},R,{},&used);
+    ASSERT_EQ(R,E);
+    ASSERT_EQ(used.to_string(),"((M0 M1) M2)");
+
+    // Random chains against left to right products, small entries so that nothing overflows
+    const std::vector<int> dims = {17,3,40,1,25,8,33};
+    std::vector<DenseMatrix> M(dims.size()-1);
+    std::vector<const DenseMatrix*> chain;
+    for(size_t m=0;m<M.size();++m){
+        build_random_matrix(M[m],dims[m],dims[m+1],m,-3,3);
+        chain.push_back(&M[m]);
+    }
+
+    for(size_t n=1;n<=M.size();++n){
+        DenseMatrix expected = M[0], tmp;
+        for(size_t m=1;m<n;++m){
+            multiplyMatricesWithoutErrors(expected,M[m],tmp);
+            expected = tmp;
+        }
+
+        const std::vector<const DenseMatrix*> prefix(chain.begin(),chain.begin()+n);
+        multiplyChain(prefix,R);
+        ASSERT_EQ(R,expected);
+
+        ChainOptions sparse;
+        sparse.sparsity_aware = true;
+        multiplyChain(prefix,R,sparse);
+        ASSERT_EQ(R,expected);
+    }
+
+    // Square factors are a tie for the dense model (the first split wins), a very sparse
+    // first factor makes it cheaper to start from it
+    const std::vector<int> shape = {100,100,100,100};
+    ASSERT_EQ(plan_matrix_chain(shape).to_string(),"(M0 (M1 M2))");
+    ASSERT_EQ(plan_matrix_chain(shape,{0.001,1.0,1.0},sparse_chain_cost).to_string(),"((M0 M1) M2)");
+
+    DenseMatrix bad(4,4);
+    ASSERT_THROW(multiplyChain({&A,&bad},R),std::invalid_argument);
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, PooledMatrixBuffers){
+
+    // Every buffer is aligned on a cache line, whatever the shape
+    for(int n : {1,3,17,64,100}){
+        DenseMatrix M;
+        build_random_matrix(M,n,n+1,n);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(M.data())%MATRIX_ALIGNMENT,0u);
+    }
+
+    // A freed buffer is handed to the next matrix of the same shape
+    const int *previous;
+    {
+        DenseMatrix M(37,41);
+        previous = M.data();
+    }
+    const BufferPoolStats before = default_buffer_pool().stats();
+    DenseMatrix reused(37,41);
+    ASSERT_EQ(reused.data(),previous);
+    ASSERT_EQ(default_buffer_pool().stats().hits,before.hits+1);
+
+    // Repeated products of the same shape stop allocating after the first round
+    DenseMatrix A, B, C;
+    build_random_matrix(A,70,50,1);
+    build_random_matrix(B,50,90,2);
+    for(int round=0;round<3;++round){
+        DenseMatrix E;
+        multiplyMatricesWithoutErrors(A,B,E);
+        multiplyMatricesStrassen(A,B,C,8);
+        ASSERT_EQ(C,E);
+    }
+    const size_t misses = default_buffer_pool().stats().misses;
+    {
+        DenseMatrix E;
+        multiplyMatricesWithoutErrors(A,B,E);
+        multiplyMatricesStrassen(A,B,C,8);
+    }
+    ASSERT_EQ(default_buffer_pool().stats().misses,misses);
+
+    // Arena: opt-in per matrix, released together (and only) when the scope ends
+    DenseMatrix expected;
+    multiplyMatricesBlocked(A,B,expected);
+    DenseMatrix outside;
+    MatrixArena arena(1<<16);
+    {
+        ArenaScope outer(arena);
+        DenseMatrix T(10,10,arena);
+        ASSERT_EQ(T.arena(),&arena);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(T.data())%MATRIX_ALIGNMENT,0u);
+        const size_t used = arena.used();
+        ASSERT_GT(used,0u);
+
+        {
+            ArenaScope inner(arena);
+            DenseMatrix D(arena);
+            multiplyMatricesWithoutErrors(A,B,D);
+            ASSERT_EQ(D.arena(),&arena);
+            ASSERT_EQ(D,expected);
+            ASSERT_GT(arena.used(),used);
+
+            // Declared outside the scopes and resized inside them: stays in the pool
+            const size_t in_arena = arena.used();
+            multiplyMatricesWithoutErrors(A,B,outside);
+            ASSERT_EQ(outside.arena(),nullptr);
+            ASSERT_EQ(arena.used(),in_arena);
+
+            // A copy does not inherit the arena either
+            const DenseMatrix copy(D);
+            ASSERT_EQ(copy.arena(),nullptr);
+        }
+        ASSERT_EQ(arena.used(),used);
+
+        // Bigger than a chunk
+        DenseMatrix big(200,200,arena);
+        big.fill(3);
+        ASSERT_EQ(big(199,199),3);
+    }
+    ASSERT_EQ(arena.used(),0u);
+
+    // The memory of the scopes is handed out again: the matrix resized inside them is untouched
+    {
+        ArenaScope scope(arena);
+        DenseMatrix reuse(200,200,arena);
+        reuse.fill(-1);
+        ASSERT_EQ(outside,expected);
+    }
+    ASSERT_EQ(outside,expected);
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, GemmMatMult){
+
+    // C = alpha*A*B + beta*C against the reference product and an explicit update.
+    // The shapes cover the edge tiles and more than one panel of K
+    const int shapes[][3] = {{1,1,1},{5,7,3},{37,41,29},{130,70,300}};
+    const int scalars[][2] = {{1,0},{1,1},{2,-3},{0,5},{-1,1}};
+
+    for(const auto &shape : shapes){
+        DenseMatrix A, B, C0, E;
+        build_random_matrix(A,shape[0],shape[2],1,-100,100);
+        build_random_matrix(B,shape[2],shape[1],2,-100,100);
+        build_random_matrix(C0,shape[0],shape[1],3,-100,100);
+        multiplyMatricesWithoutErrors(A,B,E);
+
+        for(const auto &scalar : scalars){
+            DenseMatrix C = C0, expected(shape[0],shape[1]);
+            for(int i=0;i<shape[0];++i)
+                for(int j=0;j<shape[1];++j)
+                    expected(i,j) = scalar[0]*E(i,j)+scalar[1]*C0(i,j);
+
+            multiplyMatricesGemm(A,B,C,scalar[0],scalar[1]);
+            ASSERT_EQ(C,expected);
+        }
+    }
+
+    // A sum of products accumulated in place, no temporary
+    DenseMatrix sum(40,30), expected(40,30);
+    for(int t=0;t<4;++t){
+        DenseMatrix A, B, E;
+        build_random_matrix(A,40,20+t,t,-100,100);
+        build_random_matrix(B,20+t,30,t+10,-100,100);
+        multiplyMatricesWithoutErrors(A,B,E);
+        for(int i=0;i<40;++i)
+            for(int j=0;j<30;++j)
+                expected(i,j) += E(i,j);
+
+        multiplyMatricesGemm(A,B,sum);
+    }
+    ASSERT_EQ(sum,expected);
+
+    // beta == 0 reshapes C like the other kernels, otherwise the shape has to match
+    DenseMatrix A(2,3), B(3,4), C;
+    multiplyMatricesGemm(A,B,C,1,0);
+    ASSERT_EQ(C.rows(),2);
+    ASSERT_EQ(C.cols(),4);
+    DenseMatrix wrong(4,4);
+    ASSERT_THROW(multiplyMatricesGemm(A,B,wrong,1,1),std::invalid_argument);
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, TransposedMatMult){
+
+    // op(A) * op(B) against the reference kernel on explicitly transposed copies,
+    // for shapes with edge tiles, more than one panel of K and deep enough K for the row-dot kernel
+    const int shapes[][3] = {{1,1,1},{1,9,1},{6,3,11},{37,41,29},{70,130,300},{3,6,1000},{37,21,700}};
+
+    auto transpose = [](const DenseMatrix &M){
+        DenseMatrix T(M.cols(),M.rows());
+        for(int i=0;i<M.rows();++i)
+            for(int j=0;j<M.cols();++j)
+                T(j,i) = M(i,j);
+        return T;
+    };
+
+    for(const auto &shape : shapes){
+        const int m = shape[0], n = shape[1], k = shape[2];
+
+        DenseMatrix A, B, E;
+        build_random_matrix(A,m,k,1);
+        build_random_matrix(B,k,n,2);
+        multiplyMatricesWithoutErrors(A,B,E);
+
+        const DenseMatrix At = transpose(A), Bt = transpose(B);
+
+        for(Transpose ta : {Transpose::No,Transpose::Yes}){
+            for(Transpose tb : {Transpose::No,Transpose::Yes}){
+                DenseMatrix C;
+                multiplyMatricesWithoutErrors(ta==Transpose::Yes ? At : A,ta,tb==Transpose::Yes ? Bt : B,tb,C);
+                ASSERT_EQ(C,E);
+            }
+        }
+
+        // Column-major views are no longer copied either
+        DenseMatrix C;
+        multiplyMatricesWithoutErrors(MatrixView<int>(At).transposed(),MatrixView<int>(Bt).transposed(),C);
+        ASSERT_EQ(C,E);
+    }
+
+    // The Gram matrix A * A^T is symmetric
+    DenseMatrix A, G;
+    build_random_matrix(A,50,80,3);
+    multiplyMatricesWithoutErrors(A,Transpose::No,A,Transpose::Yes,G);
+    ASSERT_EQ(G,transpose(G));
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, GemvMatMult){
+
+    // Matrix-vector and vector-matrix shapes through every entry point, against the reference
+    // kernel. The large ones are split across the thread pool
+    const int shapes[][2] = {{1,1},{7,5},{3000,40},{40,3000}};
+
+    for(const auto &shape : shapes){
+        const int m = shape[0], k = shape[1];
+
+        DenseMatrix A, x, E;
+        build_random_matrix(A,m,k,1);
+        build_random_matrix(x,k,1,2);
+        multiplyMatricesWithoutErrors(A,x,E);
+
+        // GEMV
+        DenseMatrix C;
+        multiplyMatricesBlocked(A,x,C);
+        ASSERT_EQ(C,E);
+        multiplyMatricesParallel(A,x,C);
+        ASSERT_EQ(C,E);
+
+        std::vector<int> xs(k), y;
+        for(int p=0;p<k;++p) xs[p] = x(p,0);
+        multiplyMatrixVector(A,xs,y);
+        for(int i=0;i<m;++i) ASSERT_EQ(y[i],E(i,0));
+
+        Matrix Cv(m,std::vector<int>(1,0));
+        multiplyMatricesWithoutErrors(A.to_vectors(),x.to_vectors(),Cv,m,k,1);
+        ASSERT_EQ(Cv,E.to_vectors());
+
+        // Padded column vectors
+        DenseMatrix xp(k,1,3), Cp(m,1,5);
+        for(int p=0;p<k;++p) xp(p,0) = x(p,0);
+        multiplyMatricesParallel(A,xp,Cp);
+        ASSERT_EQ(Cp,E);
+
+        // GEVM, with the transpose of the same data: x^T * A^T = (A * x)^T
+        DenseMatrix xt(1,k), At(k,m), Et(1,m);
+        for(int p=0;p<k;++p) xt(0,p) = x(p,0);
+        for(int i=0;i<m;++i){
+            Et(0,i) = E(i,0);
+            for(int p=0;p<k;++p) At(p,i) = A(i,p);
+        }
+
+        multiplyMatricesBlocked(xt,At,C);
+        ASSERT_EQ(C,Et);
+        multiplyMatricesParallel(xt,At,C);
+        ASSERT_EQ(C,Et);
+
+        multiplyVectorMatrix(xs,At,y);
+        for(int i=0;i<m;++i) ASSERT_EQ(y[i],E(i,0));
+
+        Matrix Ct(1,std::vector<int>(m,0));
+        multiplyMatricesWithoutErrors(xt.to_vectors(),At.to_vectors(),Ct,1,k,m);
+        ASSERT_EQ(Ct,Et.to_vectors());
+    }
+
+}
+
+TEST(CorrectMatrixMutltiplicationTest, InstrumentedCalls) {
+    reset_instrumentation();
+
+    DenseMatrix A(3,4), B(4,5), C, x(4,1);
+    build_random_matrix(A,3,4,1);
+    build_random_matrix(B,4,5,2);
+    build_random_matrix(x,4,1,3);
+
+    multiplyMatricesWithoutErrors(A,B,C);
+    multiplyMatricesWithoutErrors(A,B,C);
+    multiplyMatricesParallel(A,x,C);
+    Matrix Cv(3,std::vector<int>(1,0));
+    multiplyMatricesWithoutErrors(A.to_vectors(),x.to_vectors(),Cv,3,4,1);
+
+    const std::vector<MultiplyCallStats> stats = instrumentation_stats();
+    std::stringstream csv;
+    dump_instrumentation_csv(csv);
+
+#ifdef MATRIX_INSTRUMENTATION
+    // One aggregate per (entry, kernel, shape), nested calls are folded in the outermost one
+    ASSERT_EQ(stats.size(),3u);
+
+    long long calls = 0;
+    for(const MultiplyCallStats &s : stats){
+        calls += s.calls;
+
+        long long histogram = 0;
+        for(long long n : s.histogram) histogram += n;
+        ASSERT_EQ(histogram,s.calls);
+        ASSERT_LE(s.min_seconds,s.max_seconds);
+        ASSERT_GE(s.threads,1);
+
+        if(s.entry=="reference"){
+            ASSERT_EQ(s.calls,2);
+            ASSERT_EQ(s.kernel,"reference");
+            ASSERT_EQ(s.rowsA,3); ASSERT_EQ(s.colsA,4); ASSERT_EQ(s.colsB,5);
+        }else if(s.entry=="parallel"){
+            ASSERT_EQ(s.kernel,"gemv");
+            ASSERT_EQ(s.colsB,1);
+        }else{
+            ASSERT_EQ(s.entry,"vectors");
+            ASSERT_EQ(s.kernel,"gemv");
+            // The buffers of x and y
+            ASSERT_GE(s.bytes_allocated,7*sizeof(int));
+        }
+    }
+    ASSERT_EQ(calls,4);
+
+    std::string line;
+    int lines = 0;
+    while(std::getline(csv,line)) ++lines;
+    ASSERT_EQ(lines,4);
+
+    reset_instrumentation();
+    ASSERT_TRUE(instrumentation_stats().empty());
+#else
+    // Compiled out: nothing is recorded
+    ASSERT_TRUE(stats.empty());
+    ASSERT_EQ(csv.str().find('\n'),csv.str().size()-1);
+#endif
+}
+
+TEST(CorrectMatrixMutltiplicationTest, TunedMatMult) {
+    // Every configuration gives the reference result, ragged shapes included
+    for(const auto &shape : std::vector<std::vector<int>>{{37,53,29},{64,64,64},{1,7,5},{9,1,3},{130,300,70}}){
+        DenseMatrix A, B, E, C;
+        build_random_matrix(A,shape[0],shape[1],1);
+        build_random_matrix(B,shape[1],shape[2],2);
+        multiplyMatricesWithoutErrors(A,B,E);
+
+        std::vector<TuningConfig> candidates = tuning_candidates(shape[0],shape[1],shape[2]);
+        ASSERT_FALSE(candidates.empty());
+
+        TuningConfig split;
+        split.order = TunedLoopOrder::IKJ;
+        split.unroll = 4;
+        split.threads = 3;
+        candidates.push_back(split);
+        split.order = TunedLoopOrder::Packed;
+        candidates.push_back(split);
+
+        for(const TuningConfig &config : candidates){
+            multiplyMatricesTuned(A,B,C,config);
+            ASSERT_EQ(C,E) << config.to_string();
+        }
+    }
+
+    const std::string path = testing::TempDir()+"se4hpc_tuning_cache";
+    std::remove(path.c_str());
+    set_tuning_cache_path(path);
+    ASSERT_EQ(tuning_cache_size(),0u);
+
+    TuningConfig config;
+    ASSERT_FALSE(find_tuned_config(72,40,56,config));
+
+    AutotuneOptions options;
+    options.repetitions = 1;
+    const AutotuneResult tuned = autotune_multiplication(72,40,56,options);
+    ASSERT_GT(tuned.gops,0.0);
+    ASSERT_TRUE(find_tuned_config(72,40,56,config));
+    ASSERT_EQ(config,tuned.config);
+
+    // The winner is persisted, the entries of other CPUs are kept but never used
+    {
+        std::ofstream out(path,std::ios::app);
+        out << "Some Other CPU|int32|72 40 56|ikj 1 1 1 1 1|0.5\n";
+    }
+    set_tuning_cache_path(path);
+    ASSERT_EQ(tuning_cache_size(),1u);
+    ASSERT_TRUE(find_tuned_config(72,40,56,config));
+    ASSERT_EQ(config,tuned.config);
+
+    save_tuning_cache();
+    {
+        std::ifstream in(path);
+        const std::string text((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+        ASSERT_NE(text.find("Some Other CPU|int32|72 40 56|ikj 1 1 1 1 1|"),std::string::npos);
+        ASSERT_NE(text.find(cpu_model_name()),std::string::npos);
+    }
+
+    // The vector of vectors signature dispatches to the tuned configuration
+    const Matrix A = build_random_matrix(72,40,3);
+    const Matrix B = build_random_matrix(40,56,4);
+    Matrix C(72,std::vector<int>(56,0));
+    multiplyMatricesWithoutErrors(A,B,C,72,40,56);
+    ASSERT_EQ(last_multiply_dispatch().path,MultiplyPath::Tuned);
+
+    DenseMatrix E;
+    multiplyMatricesWithoutErrors(DenseMatrix(A,72,40),DenseMatrix(B,40,56),E);
+    ASSERT_EQ(C,E.to_vectors());
+
+    ASSERT_THROW(autotune_multiplication(0,4,4),std::invalid_argument);
+
+    // Corrupted entries are skipped when the file is loaded, they never size the packed panels
+    {
+        std::ofstream out(path,std::ios::trunc);
+        const std::string cpu = cpu_model_name();
+        out << cpu << "|int32|10 10 10|packed 6 64 64 1 1|1\n";
+        out << cpu << "|int32|11 11 11|packed 64 1073741824 64 1 1|1\n";
+        out << cpu << "|int32|12 12 12|ikj 64 64 64 3 1|1\n";
+        out << cpu << "|int32|13 13 13|ikj -4 64 64 1 1|1\n";
+        out << cpu << "|int32|14 14 14|packed 64 64 64 1 0|1\n";
+        out << cpu << "|int32|15 15 15|packed 64 64 64 1 1|1\n";
+    }
+    set_tuning_cache_path(path);
+    ASSERT_EQ(tuning_cache_path(),path);
+    ASSERT_EQ(tuning_cache_size(),1u);
+    ASSERT_TRUE(find_tuned_config(15,15,15,config));
+
+    std::remove(path.c_str());
+    clear_tuning_cache();
+}
+
+TEST(CorrectMatrixMutltiplicationTest, DispatchMatMult) {
+    // No entry in the tuning cache may divert the shapes below
+    clear_tuning_cache();
+
+    auto check = [](const Matrix &A, const Matrix &B, int rowsA, int colsA, int colsB, MultiplyPath path) {
+        DenseMatrix E;
+        multiplyMatricesWithoutErrors(DenseMatrix(A,rowsA,colsA),DenseMatrix(B,colsA,colsB),E);
+
+        Matrix C(rowsA,std::vector<int>(colsB,7));
+        ASSERT_EQ(choose_multiply_path(A,B,rowsA,colsA,colsB).path,path);
+        multiplyMatricesWithoutErrors(A,B,C,rowsA,colsA,colsB);
+        ASSERT_EQ(last_multiply_dispatch().path,path) << multiply_path_name(path);
+        ASSERT_EQ(C,E.to_vectors()) << multiply_path_name(path);
+    };
+
+    check({{-3}},{{5}},1,1,1,MultiplyPath::Scalar);
+    check(build_random_matrix(5,4,1),build_random_matrix(4,1,2),5,4,1,MultiplyPath::MatrixVector);
+    check(build_random_matrix(1,4,1),build_random_matrix(4,5,2),1,4,5,MultiplyPath::VectorMatrix);
+    check(build_random_matrix(6,1,1),build_random_matrix(1,7,2),6,1,7,MultiplyPath::OuterProduct);
+    check(build_random_matrix(40,50,1),build_random_matrix(50,30,2),40,50,30,MultiplyPath::Packed);
+    check(build_random_matrix(2,2,1),build_random_matrix(2,2,2),2,2,2,MultiplyPath::SmallIKJ);
+    check(build_random_matrix(37,45,1),build_random_matrix(45,70,2),37,45,70,MultiplyPath::SmallIKJ);
+    check(build_random_matrix(90,45,1),build_random_matrix(45,70,2),90,45,70,MultiplyPath::Packed);
+
+    // Mostly zeros in A
+    Matrix S = build_random_matrix(70,50,3);
+    for(int i=0;i<70;++i)
+        for(int k=0;k<50;++k)
+            if((i*7+k*3)%5) S[i][k] = 0;
+    check(S,build_random_matrix(50,30,4),70,50,30,MultiplyPath::SparseIKJ);
+    ASSERT_GE(last_multiply_dispatch().zero_fraction,0.75);
+
+    // An empty inner dimension gives zeros, an empty result touches nothing
+    Matrix Z(3,std::vector<int>(2,7));
+    multiplyMatricesWithoutErrors(Matrix(3),Matrix(),Z,3,0,2);
+    ASSERT_EQ(last_multiply_dispatch().path,MultiplyPath::Empty);
+    ASSERT_EQ(Z,Matrix(3,std::vector<int>(2,0)));
+
+    // C aliasing A is never computed in place
+    Matrix T = S;
+    T.resize(50);
+    const Matrix B = build_random_matrix(50,50,5);
+    DenseMatrix E;
+    multiplyMatricesWithoutErrors(DenseMatrix(T,50,50),DenseMatrix(B,50,50),E);
+    multiplyMatricesWithoutErrors(T,B,T,50,50,50);
+    ASSERT_EQ(last_multiply_dispatch().path,MultiplyPath::Packed);
+    ASSERT_EQ(T,E.to_vectors());
+
+    // Nor on the vector paths, whichever operand C is
+    auto checkAliased = [](Matrix A, Matrix B, int rowsA, int colsA, int colsB, bool intoA, MultiplyPath path) {
+        DenseMatrix E;
+        multiplyMatricesWithoutErrors(DenseMatrix(A,rowsA,colsA),DenseMatrix(B,colsA,colsB),E);
+
+        Matrix &C = intoA ? A : B;
+        multiplyMatricesWithoutErrors(A,B,C,rowsA,colsA,colsB);
+        ASSERT_EQ(last_multiply_dispatch().path,path) << multiply_path_name(path);
+        // The product is the leading rowsA x colsB block of C
+        ASSERT_EQ(DenseMatrix(C,rowsA,colsB),E) << multiply_path_name(path);
+    };
+    checkAliased(build_random_matrix(1,9,6),build_random_matrix(9,9,7),1,9,9,true,MultiplyPath::VectorMatrix);
+    checkAliased(build_random_matrix(1,1,6),build_random_matrix(1,9,7),1,1,9,false,MultiplyPath::VectorMatrix);
+    checkAliased(build_random_matrix(9,9,6),build_random_matrix(9,1,7),9,9,1,false,MultiplyPath::MatrixVector);
+    checkAliased(build_random_matrix(9,9,6),build_random_matrix(9,1,7),9,9,1,true,MultiplyPath::MatrixVector);
+}
+
 int main(int argc, char **argv) {
 	testing::InitGoogleTest(&argc, argv);
 	return RUN_ALL_TESTS();
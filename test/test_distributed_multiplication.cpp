@@ -0,0 +1,268 @@
+#include "distributed_multiplication.h"
+#include "matrix_multiplication.h"
+#include "matrix_utils.h"
+#include <mpi.h>
+#include <vector>
+#include <gtest/gtest.h>
+
+/*
+
+Tests of the distributed multiplication, meant to be run under MPI, e.g.
+
+    mpirun -np 4 ./test_multiplication_distributed
+
+Every process runs every test (the algorithms are collective), the results are
+assembled and checked on rank 0 against multiplyMatricesWithoutErrors on the
+whole matrices. Only rank 0 prints.
+
+The checks are EXPECT_* rather than ASSERT_*: a process leaving a test early would
+leave the others waiting in a collective call.
+
+*/
+
+namespace {
+
+int
+world_rank() {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return rank;
+}
+
+int
+world_size() {
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return size;
+}
+
+// Communicator of the first n processes of MPI_COMM_WORLD, MPI_COMM_NULL on the others
+MPI_Comm
+first_processes(int n) {
+    MPI_Comm comm;
+    MPI_Comm_split(MPI_COMM_WORLD, world_rank() < n ? 0 : MPI_UNDEFINED, world_rank(), &comm);
+    return comm;
+}
+
+// Sent and received bytes summed over the processes of comm have to match
+void
+expect_balanced(const CommunicationStats &stats, MPI_Comm comm) {
+    long long volume[2] = {stats.bytes_sent, stats.bytes_received};
+    MPI_Allreduce(MPI_IN_PLACE, volume, 2, MPI_LONG_LONG, MPI_SUM, comm);
+    EXPECT_EQ(volume[0], volume[1]);
+}
+
+const int SHAPES[][3] = {{1,1,1},{17,23,9},{64,64,64},{50,7,91},{3,40,2}};
+
+}
+
+TEST(DistributedMatrixMultiplicationTest, BlockCyclicLayout){
+
+    // Scattering and gathering back gives the matrix again, and every process
+    // generating its own blocks gives the same matrix as build_random_matrix
+
+    ProcessGrid grid(MPI_COMM_WORLD);
+    EXPECT_EQ(grid.rows()*grid.cols(),world_size());
+
+    for(int nb : {1,4,7,64}){
+
+        DenseMatrix M, back, generated;
+        build_random_matrix(M,29,45,nb);
+
+        DistributedMatrix D(grid,29,45,nb);
+        scatter_matrix(M,D);
+        gather_matrix(D,back);
+
+        DistributedMatrix R(grid,29,45,nb);
+        build_random_matrix(R,nb);
+        gather_matrix(R,generated);
+
+        // The local blocks are where the layout says
+        for(int i=0;i<D.local().rows();++i)
+            for(int j=0;j<D.local().cols();++j)
+                EXPECT_EQ(D.local()(i,j),M(D.local_to_global_row(i),D.local_to_global_col(j)));
+
+        if(grid.rank()==0){
+            EXPECT_EQ(back,M);
+            EXPECT_EQ(generated,M);
+        }
+
+    }
+
+    // The extents of all the processes add up
+    for(int n : {0,1,10,64,65}){
+        int total = 0;
+        for(int p=0;p<3;++p) total += block_cyclic_extent(n,4,p,3);
+        EXPECT_EQ(total,n);
+    }
+
+}
+
+TEST(DistributedMatrixMultiplicationTest, SummaMatMult){
+
+    // SUMMA on the square-ish grid and on the two 1D grids, for block sizes that do and do not
+    // divide the dimensions, against the reference kernel on rank 0
+
+    const int P = world_size();
+    const int grids[][2] = {{0,0},{1,P},{P,1}};
+    for(const auto &g : grids){
+        ProcessGrid grid(MPI_COMM_WORLD,g[0],g[1]);
+
+        for(int nb : {1,5,16}){
+            for(const auto &shape : SHAPES){
+                const int m = shape[0], n = shape[1], k = shape[2];
+
+                DistributedMatrix A(grid,m,k,nb), B(grid,k,n,nb), C(grid,m,n,nb);
+                build_random_matrix(A,1);
+                build_random_matrix(B,2);
+
+                multiplyMatricesSumma(A,B,C);
+
+                DenseMatrix globalA, globalB, globalC, E;
+                gather_matrix(A,globalA);
+                gather_matrix(B,globalB);
+                gather_matrix(C,globalC);
+
+                if(grid.rank()==0){
+                    multiplyMatricesWithoutErrors(globalA,globalB,E);
+                    EXPECT_EQ(globalC,E);
+                }
+            }
+        }
+    }
+
+    // Mismatched operands are refused on every process
+    ProcessGrid grid(MPI_COMM_WORLD);
+    DistributedMatrix A(grid,4,5,2), B(grid,6,4,2), C(grid,4,4,2), D(grid,5,4,3);
+    EXPECT_THROW(multiplyMatricesSumma(A,B,C),std::invalid_argument);
+    EXPECT_THROW(multiplyMatricesSumma(A,D,C),std::invalid_argument);
+
+}
+
+TEST(DistributedMatrixMultiplicationTest, CannonMatMult){
+
+    // Cannon on every square grid that fits in the processes, the others sit out
+
+    for(int q=1;q*q<=world_size();++q){
+        MPI_Comm comm = first_processes(q*q);
+        if(comm==MPI_COMM_NULL) continue;
+
+        {
+            ProcessGrid grid(comm,q,q);
+
+            for(int nb : {1,5,16}){
+                for(const auto &shape : SHAPES){
+                    const int m = shape[0], n = shape[1], k = shape[2];
+
+                    DistributedMatrix A(grid,m,k,nb), B(grid,k,n,nb), C(grid,m,n,nb), S(grid,m,n,nb);
+                    build_random_matrix(A,1);
+                    build_random_matrix(B,2);
+
+                    CommunicationStats stats;
+                    multiplyMatricesCannon(A,B,C,&stats);
+                    multiplyMatricesSumma(A,B,S);
+                    expect_balanced(stats,comm);
+                    if(q==1){
+                        EXPECT_EQ(stats.bytes_sent,0);
+                    }
+
+                    DenseMatrix globalA, globalB, globalC, globalS, E;
+                    gather_matrix(A,globalA);
+                    gather_matrix(B,globalB);
+                    gather_matrix(C,globalC);
+                    gather_matrix(S,globalS);
+
+                    if(grid.rank()==0){
+                        multiplyMatricesWithoutErrors(globalA,globalB,E);
+                        EXPECT_EQ(globalC,E);
+                        EXPECT_EQ(globalS,E);
+                    }
+                }
+            }
+
+            // Cannon needs a square grid
+            if(q>1){
+                ProcessGrid line(comm,1,q*q);
+                DistributedMatrix A(line,4,4,2), B(line,4,4,2), C(line,4,4,2);
+                EXPECT_THROW(multiplyMatricesCannon(A,B,C),std::invalid_argument);
+            }
+        }
+
+        MPI_Comm_free(&comm);
+    }
+
+}
+
+TEST(DistributedMatrixMultiplicationTest, Cannon25DMatMult){
+
+    // Every q x q x c arrangement with q >= c that fits (c = 2 needs 8 processes). The result
+    // is gathered from layer 0 only
+
+    for(int c=1;c<=world_size();++c){
+        for(int q=c;q*q*c<=world_size();++q){
+            MPI_Comm comm = first_processes(q*q*c);
+            if(comm==MPI_COMM_NULL) continue;
+
+            {
+                LayeredProcessGrid grid(comm,c);
+                const ProcessGrid &layer = grid.layer_grid();
+                EXPECT_EQ(layer.rows(),q);
+
+                for(int nb : {1,5,16}){
+                    for(const auto &shape : SHAPES){
+                        const int m = shape[0], n = shape[1], k = shape[2];
+
+                        DistributedMatrix A(layer,m,k,nb), B(layer,k,n,nb), C(layer,m,n,nb);
+
+                        // Only layer 0 has the operands, the others get them from the algorithm
+                        if(grid.layer()==0){
+                            build_random_matrix(A,1);
+                            build_random_matrix(B,2);
+                        }
+
+                        CommunicationStats stats;
+                        multiplyMatrices25D(grid,A,B,C,&stats);
+                        expect_balanced(stats,comm);
+
+                        if(grid.layer()==0){
+                            DenseMatrix globalA, globalB, globalC, E;
+                            gather_matrix(A,globalA);
+                            gather_matrix(B,globalB);
+                            gather_matrix(C,globalC);
+
+                            if(layer.rank()==0){
+                                multiplyMatricesWithoutErrors(globalA,globalB,E);
+                                EXPECT_EQ(globalC,E);
+                            }
+                        }
+                    }
+                }
+            }
+
+            MPI_Comm_free(&comm);
+        }
+    }
+
+    // q * q * c processes with q >= c only
+    if(world_size()>1){
+        EXPECT_THROW(LayeredProcessGrid(MPI_COMM_WORLD,world_size()),std::invalid_argument);
+    }
+
+}
+
+int main(int argc, char **argv) {
+	MPI_Init(&argc, &argv);
+	testing::InitGoogleTest(&argc, argv);
+
+	// A single report, from rank 0
+	if (world_rank() != 0) {
+		auto &listeners = testing::UnitTest::GetInstance()->listeners();
+		delete listeners.Release(listeners.default_result_printer());
+	}
+
+	int failed = RUN_ALL_TESTS();
+	MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+	MPI_Finalize();
+	return failed;
+}